@@ -1,21 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <vector>
+#include <immintrin.h>
+
 #include "avx2mdfs.h"
+#include "stats.h"
+
+// Compiled for AVX2 and FMA by a target region, see mdfs_vector.h
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
 #include "mdfs_vector.h"
 
-void AVX2Mdfs(AlgInfo ai, DiscretizedFile *in, MDFSOutput &out)
+namespace {
+
+inline __m256i load_bytes(const uint8_t *pack, int o)
+{
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(pack + 8 * o)));
+}
+
+inline __m256i load_nibbles(const uint8_t *pack, int o)
+{
+    int32_t nibbles;
+    std::memcpy(&nibbles, pack + 4 * o, sizeof(nibbles));
+    __m256i shifted = _mm256_srlv_epi32(_mm256_set1_epi32(nibbles), _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28));
+    return _mm256_and_si256(shifted, _mm256_set1_epi32(0xF));
+}
+
+inline __m256 gather(const float *table, __m256i idx)
+{
+    return _mm256_i32gather_ps(table, idx, sizeof(float));
+}
+
+inline __m256i load_counts(const uint16_t *cell)
+{
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)cell));
+}
+
+inline __m256i load_counts(const uint32_t *cell)
+{
+    return _mm256_loadu_si256((const __m256i *)cell);
+}
+
+template <__m256i(*LOADd)(const uint8_t *pack, int o),
+          typename C,
+          typename Shape>
+void avx2Mdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
 {
-    VectorDiscretizedFile<8> *vin = new VectorDiscretizedFile<8>(in);
     vectorMdfs<8,
                __m256,
                _mm256_set1_ps,
-               _mm256_mul_ps,
                _mm256_add_ps,
                _mm256_sub_ps,
-               _mm256_fmadd_ps,
-               log_scalar<8, __m256>,//_mm256_log_ps,
                __m256i,
                _mm256_set1_epi32,
                _mm256_mullo_epi32,
-               _mm256_add_epi32>(ai, vin, out);
+               _mm256_add_epi32,
+               LOADd,
+               C,
+               load_counts,
+               gather,
+               Shape>(ai, in, out);
+}
 
-    delete vin;
+template <__m256i(*LOADd)(const uint8_t *pack, int o),
+          typename Shape>
+void avx2Mdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    if (in->info.objectCount < 65536)
+        avx2Mdfs<LOADd, uint16_t, Shape>(ai, in, out);
+    else
+        avx2Mdfs<LOADd, uint32_t, Shape>(ai, in, out);
 }
+
+template <typename Shape>
+void avx2Mdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    switch (in->info.storage) {
+        case DiscretizedStorage::Nibble:
+            avx2Mdfs<load_nibbles, Shape>(ai, in, out);
+            break;
+        case DiscretizedStorage::Byte:
+            avx2Mdfs<load_bytes, Shape>(ai, in, out);
+            break;
+        default:
+            break;
+    }
+}
+
+struct ObjectLanes {
+    static const int VL = 8;
+    typedef __m256i Td;
+    static Td SETd(int a) { return _mm256_set1_epi32(a); }
+    static Td MULd(Td a, Td b) { return _mm256_mullo_epi32(a, b); }
+    static Td ADDd(Td a, Td b) { return _mm256_add_epi32(a, b); }
+};
+
+struct NibbleObjectLanes : ObjectLanes {
+    static Td LOADd(const uint8_t *pack, int o) { return load_nibbles(pack, o); }
+};
+
+struct ByteObjectLanes : ObjectLanes {
+    static Td LOADd(const uint8_t *pack, int o) { return load_bytes(pack, o); }
+};
+
+template <typename Shape>
+void avx2ObjectLaneMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    switch (in->info.storage) {
+        case DiscretizedStorage::Nibble:
+            denseMdfs<ObjectLaneCounter<NibbleObjectLanes>, Shape>(ai, in, out);
+            break;
+        case DiscretizedStorage::Byte:
+            denseMdfs<ObjectLaneCounter<ByteObjectLanes>, Shape>(ai, in, out);
+            break;
+        default:
+            break;
+    }
+}
+
+}
+
+void AVX2Mdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    avx2Mdfs<RuntimeShape>(ai, in, out);
+}
+
+template <int DIM, int DIV>
+void AVX2MdfsFixed(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    avx2Mdfs<FixedShape<DIM, DIV>>(ai, in, out);
+}
+
+void AVX2ObjectLaneMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    avx2ObjectLaneMdfs<RuntimeShape>(ai, in, out);
+}
+
+template <int DIM, int DIV>
+void AVX2ObjectLaneMdfsFixed(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    avx2ObjectLaneMdfs<FixedShape<DIM, DIV>>(ai, in, out);
+}
+
+#define INSTANTIATE(DIM, DIV) \
+    template void AVX2MdfsFixed<DIM, DIV>(const AlgInfo &, DiscretizedFile *, MDFSOutput &); \
+    template void AVX2ObjectLaneMdfsFixed<DIM, DIV>(const AlgInfo &, DiscretizedFile *, MDFSOutput &);
+MDFS_FIXED_SHAPES(INSTANTIATE)
+#undef INSTANTIATE
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
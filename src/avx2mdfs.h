@@ -3,6 +3,14 @@
 
 #include "mdfs_common.h"
 
-void AVX2Mdfs(AlgInfo ai, DiscretizedFile *in, MDFSOutput &out);
+// AVX2Mdfs reads 8 discretizations interleaved per column (lanes = 8)
+void AVX2Mdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out);
+void AVX2ObjectLaneMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out);
+
+// The same for a fixed shape, instantiated for MDFS_FIXED_SHAPES
+template <int DIM, int DIV>
+void AVX2MdfsFixed(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out);
+template <int DIM, int DIV>
+void AVX2ObjectLaneMdfsFixed(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out);
 
 #endif
@@ -1,20 +1,170 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <vector>
+#include <immintrin.h>
+
 #include "avxmdfs.h"
+#include "stats.h"
+
+// Compiled for AVX by a target region, see mdfs_vector.h
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx")
+#endif
+
 #include "mdfs_vector.h"
 
-void AVXMdfs(AlgInfo ai, DiscretizedFile *in, MDFSOutput &out)
+namespace {
+
+inline __m128i load_bytes(const uint8_t *pack, int o)
+{
+    int32_t bytes;
+    std::memcpy(&bytes, pack + 4 * o, sizeof(bytes));
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+}
+
+// there are no variable shifts in AVX, the nibbles are shifted to the top
+// of their lanes by multiplication instead
+inline __m128i load_nibbles(const uint8_t *pack, int o)
+{
+    uint16_t nibbles;
+    std::memcpy(&nibbles, pack + 2 * o, sizeof(nibbles));
+    __m128i shifted = _mm_mullo_epi32(_mm_set1_epi32(nibbles), _mm_setr_epi32(1 << 12, 1 << 8, 1 << 4, 1));
+    return _mm_and_si128(_mm_srli_epi32(shifted, 12), _mm_set1_epi32(0xF));
+}
+
+// AVX has no gathers
+inline __m128 gather(const float *table, __m128i idx)
+{
+    int32_t i[4];
+    std::memcpy(i, &idx, sizeof(idx));
+    return _mm_setr_ps(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+}
+
+inline __m128i load_counts(const uint16_t *cell)
+{
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)cell));
+}
+
+inline __m128i load_counts(const uint32_t *cell)
+{
+    return _mm_loadu_si128((const __m128i *)cell);
+}
+
+template <__m128i(*LOADd)(const uint8_t *pack, int o),
+          typename C,
+          typename Shape>
+void avxMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
 {
-    VectorDiscretizedFile<4> *vin = new VectorDiscretizedFile<4>(in);
     vectorMdfs<4,
                __m128,
                _mm_set1_ps,
-               _mm_mul_ps,
                _mm_add_ps,
                _mm_sub_ps,
-               my_fma<__m128, _mm_mul_ps, _mm_add_ps>,
-               log_scalar<4, __m128>,//_mm128_log_ps,
                __m128i,
                _mm_set1_epi32,
                _mm_mullo_epi32,
-               _mm_add_epi32>(ai, vin, out);
-    delete vin;
+               _mm_add_epi32,
+               LOADd,
+               C,
+               load_counts,
+               gather,
+               Shape>(ai, in, out);
+}
+
+template <__m128i(*LOADd)(const uint8_t *pack, int o),
+          typename Shape>
+void avxMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    if (in->info.objectCount < 65536)
+        avxMdfs<LOADd, uint16_t, Shape>(ai, in, out);
+    else
+        avxMdfs<LOADd, uint32_t, Shape>(ai, in, out);
+}
+
+template <typename Shape>
+void avxMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    switch (in->info.storage) {
+        case DiscretizedStorage::Nibble:
+            avxMdfs<load_nibbles, Shape>(ai, in, out);
+            break;
+        case DiscretizedStorage::Byte:
+            avxMdfs<load_bytes, Shape>(ai, in, out);
+            break;
+        default:
+            break;
+    }
+}
+
+struct ObjectLanes {
+    static const int VL = 4;
+    typedef __m128i Td;
+    static Td SETd(int a) { return _mm_set1_epi32(a); }
+    static Td MULd(Td a, Td b) { return _mm_mullo_epi32(a, b); }
+    static Td ADDd(Td a, Td b) { return _mm_add_epi32(a, b); }
+};
+
+struct NibbleObjectLanes : ObjectLanes {
+    static Td LOADd(const uint8_t *pack, int o) { return load_nibbles(pack, o); }
+};
+
+struct ByteObjectLanes : ObjectLanes {
+    static Td LOADd(const uint8_t *pack, int o) { return load_bytes(pack, o); }
+};
+
+template <typename Shape>
+void avxObjectLaneMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    switch (in->info.storage) {
+        case DiscretizedStorage::Nibble:
+            denseMdfs<ObjectLaneCounter<NibbleObjectLanes>, Shape>(ai, in, out);
+            break;
+        case DiscretizedStorage::Byte:
+            denseMdfs<ObjectLaneCounter<ByteObjectLanes>, Shape>(ai, in, out);
+            break;
+        default:
+            break;
+    }
+}
+
+}
+
+void AVXMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    avxMdfs<RuntimeShape>(ai, in, out);
+}
+
+template <int DIM, int DIV>
+void AVXMdfsFixed(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    avxMdfs<FixedShape<DIM, DIV>>(ai, in, out);
+}
+
+void AVXObjectLaneMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    avxObjectLaneMdfs<RuntimeShape>(ai, in, out);
+}
+
+template <int DIM, int DIV>
+void AVXObjectLaneMdfsFixed(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    avxObjectLaneMdfs<FixedShape<DIM, DIV>>(ai, in, out);
 }
+
+#define INSTANTIATE(DIM, DIV) \
+    template void AVXMdfsFixed<DIM, DIV>(const AlgInfo &, DiscretizedFile *, MDFSOutput &); \
+    template void AVXObjectLaneMdfsFixed<DIM, DIV>(const AlgInfo &, DiscretizedFile *, MDFSOutput &);
+MDFS_FIXED_SHAPES(INSTANTIATE)
+#undef INSTANTIATE
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -3,6 +3,14 @@
 
 #include "mdfs_common.h"
 
-void AVXMdfs(AlgInfo ai, DiscretizedFile *in, MDFSOutput &out);
+// AVXMdfs reads 4 discretizations interleaved per column (lanes = 4)
+void AVXMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out);
+void AVXObjectLaneMdfs(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out);
+
+// The same for a fixed shape, instantiated for MDFS_FIXED_SHAPES
+template <int DIM, int DIV>
+void AVXMdfsFixed(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out);
+template <int DIM, int DIV>
+void AVXObjectLaneMdfsFixed(const AlgInfo &ai, DiscretizedFile *in, MDFSOutput &out);
 
 #endif
@@ -0,0 +1,51 @@
+#include "cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+struct CPUFeatures {
+    bool avx = false;
+    bool avx2 = false;
+
+    CPUFeatures() {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return;
+        }
+
+        const bool osxsave = ecx & bit_OSXSAVE;
+        const bool sse41 = ecx & bit_SSE4_1;
+        const bool fma = ecx & bit_FMA;
+        if (!osxsave || !(ecx & bit_AVX)) {
+            return;
+        }
+
+        // XCR0 bits 1 and 2: the OS preserves the XMM and YMM state
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+        if ((xcr0_lo & 0x6) != 0x6) {
+            return;
+        }
+
+        // the AVX kernel also uses SSE4.1 integer instructions
+        avx = sse41;
+
+        if (__get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            avx2 = avx && fma && (ebx & bit_AVX2);
+        }
+#endif
+    }
+};
+
+static const CPUFeatures features;
+
+bool cpuSupportsAVX() {
+    return features.avx;
+}
+
+bool cpuSupportsAVX2() {
+    return features.avx2;
+}
@@ -0,0 +1,11 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// Instruction sets the vector kernels are built for, probed once when the
+// library is loaded. Both the CPU and the OS (which has to save the YMM
+// registers) must support them.
+
+bool cpuSupportsAVX();
+bool cpuSupportsAVX2();
+
+#endif
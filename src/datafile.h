@@ -9,19 +9,17 @@ public:
     int variableCount;
 };
 
-//Stored in VO way
+// Stored in VO way, which is how R stores a matrix, so the file is a
+// non-owning view over the caller's buffers; they must outlive it
 
 class DataFile {
 
 public:
-    DataFile(DataFileInfo dfi);
-    DataFile(DataFileInfo dfi, double* data, int *decision);
-    ~DataFile();
+    DataFile(DataFileInfo dfi, const double *data, const int *decision);
     DataFileInfo info;
-    void allocate();
-    float * data;
-    int * decision;
-    float *getV(int var);
+    const double * data;
+    const int * decision;
+    const double *getV(int var) const;
 };
 
 #endif
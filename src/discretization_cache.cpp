@@ -0,0 +1,135 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "discretization_cache.h"
+
+static inline uint64_t mix(uint64_t h, uint64_t w) {
+    h ^= w * 0x9E3779B97F4A7C15ULL;
+    h = (h << 31) | (h >> 33);
+    return h * 0xBF58476D1CE4E5B9ULL;
+}
+
+// Columns are hashed in parallel and their hashes combined in order
+static uint64_t hashData(const DataFile *df) {
+    std::vector<uint64_t> columns(df->info.variableCount);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int v = 0; v < df->info.variableCount; v++) {
+        const double *column = df->getV(v);
+        uint64_t h = v;
+        for (int o = 0; o < df->info.objectCount; o++) {
+            uint64_t bits;
+            std::memcpy(&bits, column + o, sizeof(bits));
+            h = mix(h, bits);
+        }
+        columns[v] = h;
+    }
+
+    uint64_t h = mix(df->info.objectCount, df->info.variableCount);
+    for (int o = 0; o < df->info.objectCount; o++) {
+        h = mix(h, df->decision[o]);
+    }
+    for (int v = 0; v < df->info.variableCount; v++) {
+        h = mix(h, columns[v]);
+    }
+    return h;
+}
+
+DiscretizationKey::DiscretizationKey(const DataFile *df, DiscretizationInfo di, DiscretizedFileInfo dfi) : info(dfi) {
+    source.dataHash = hashData(df);
+    source.seed = di.seed;
+    source.range = di.range;
+}
+
+bool DiscretizationKey::operator==(const DiscretizationKey &other) const {
+    return info.discretizations == other.info.discretizations &&
+           info.objectCount == other.info.objectCount &&
+           info.variableCount == other.info.variableCount &&
+           info.divisions == other.info.divisions &&
+           info.lanes == other.info.lanes &&
+           source.dataHash == other.source.dataHash &&
+           source.seed == other.source.seed &&
+           source.range == other.source.range;
+}
+
+std::string DiscretizationKey::name() const {
+    uint32_t range;
+    std::memcpy(&range, &source.range, sizeof(range));
+    uint64_t h = mix(source.dataHash, source.seed);
+    h = mix(h, range);
+    h = mix(h, info.discretizations);
+    h = mix(h, info.divisions);
+    h = mix(h, info.lanes);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.cucubes", (unsigned long long)h);
+    return name;
+}
+
+DiscretizationCache::DiscretizationCache() : entries(0) {}
+
+DiscretizationCache &DiscretizationCache::instance() {
+    static DiscretizationCache cache;
+    return cache;
+}
+
+void DiscretizationCache::configure(std::size_t entries, const std::string &dir) {
+    this->entries = entries;
+    this->dir = dir;
+    while (this->files.size() > this->entries) {
+        this->files.pop_back();
+    }
+}
+
+std::shared_ptr<DiscretizedFile> DiscretizationCache::discretize(const DataFile *df,
+                                                                 DiscretizationInfo di,
+                                                                 DiscretizedFileInfo dfi,
+                                                                 const std::string &stream_path) {
+    std::shared_ptr<DiscretizedFile> file(new DiscretizedFile(dfi));
+
+    // nothing to look up, so the data is not even hashed
+    if (this->entries == 0 && this->dir.empty() && stream_path.empty()) {
+        file->allocate();
+        discretizeFile(df, file.get(), di);
+        return file;
+    }
+
+    DiscretizationKey key(df, di, dfi);
+    for (auto f = this->files.begin(); f != this->files.end(); ++f) {
+        if (f->first == key) {
+            this->files.splice(this->files.begin(), this->files, f);
+            return f->second;
+        }
+    }
+
+    std::string path = !stream_path.empty() ? stream_path :
+                       !this->dir.empty() ? this->dir + "/" + key.name() : "";
+
+    if (path.empty() || !file->open(path.c_str(), key.source)) {
+        if (path.empty() || !file->create(path.c_str())) {
+            // the cache directory is only an optimization
+            if (!stream_path.empty())
+                return nullptr;
+            file->allocate();
+        }
+        discretizeFile(df, file.get(), di);
+        // one that could not be saved (e.g. the disk is full) is only used
+        // by this call, so a later one tries again
+        if (file->mapped() && !file->save(key.source))
+            return file;
+    }
+
+    this->remember(key, file);
+    return file;
+}
+
+void DiscretizationCache::remember(const DiscretizationKey &key, std::shared_ptr<DiscretizedFile> file) {
+    if (this->entries == 0)
+        return;
+    this->files.emplace_front(key, file);
+    if (this->files.size() > this->entries) {
+        this->files.pop_back();
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef DISCRETIZATION_CACHE_H
+#define DISCRETIZATION_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "datafile.h"
+#include "discretize.h"
+#include "discretizedfile.h"
+
+// Discretized files are kept between calls, keyed by a hash of the data and
+// decision, the discretization parameters and the layout, so that calls on
+// the same data skip discretizeFile. The most recent ones stay in memory;
+// with a directory they are also mapped files there, named by their key,
+// which later calls (and R sessions) map instead of discretizing again.
+// Files in the directory are never removed; it is up to the user to clean it.
+
+class DiscretizationKey {
+public:
+    DiscretizationKey(const DataFile *df, DiscretizationInfo di, DiscretizedFileInfo dfi);
+    DiscretizedFileInfo info;
+    DiscretizedSource source;
+    bool operator==(const DiscretizationKey &other) const;
+    std::string name() const;
+};
+
+class DiscretizationCache {
+public:
+    static DiscretizationCache &instance();
+    void configure(std::size_t entries, const std::string &dir);
+    // Into a mapped file at stream_path if it is not empty; nullptr if that
+    // file cannot be created
+    std::shared_ptr<DiscretizedFile> discretize(const DataFile *df,
+                                                DiscretizationInfo di,
+                                                DiscretizedFileInfo dfi,
+                                                const std::string &stream_path);
+private:
+    DiscretizationCache();
+    void remember(const DiscretizationKey &key, std::shared_ptr<DiscretizedFile> file);
+    std::size_t entries;
+    std::string dir;
+    std::list<std::pair<DiscretizationKey, std::shared_ptr<DiscretizedFile>>> files; // most recent first
+};
+
+#endif
@@ -3,73 +3,157 @@
 #include <cstdint>
 #include <cstring>
 #include <random>
+#include <limits>
 #include "discretize.h"
 
 DiscretizationInfo::DiscretizationInfo(uint32_t seed, int disc, int div, float range) :
         seed(seed), disc(disc), div(div), range(range) {}
 
-void discretize(uint32_t seed,
-                uint32_t disc,
-                uint32_t var,
-                std::size_t div,
-                std::size_t length,
-                float *in_data,
-                const std::vector<float>& sorted_in_data,
-                int32_t *out_data,
-                float range) {
+// Ranks (in the sorted column) of the thresholds of one discretization
+static void thresholdRanks(uint32_t seed,
+                           uint32_t disc,
+                           uint32_t var,
+                           std::size_t div,
+                           std::size_t length,
+                           float range,
+                           std::size_t *ranks) {
     float* thr = new float[div];
+    float sum = 0.0f;
     {
-        float sum = 0.0f;
-        {
-            std::mt19937 seedGen0(seed);
-            std::mt19937 seedGen1(seedGen0() ^ disc);
-            std::mt19937 gen(seedGen1() ^ var);
-            std::uniform_real_distribution<double> dis(1.0 - range, 1.0 + range);
-
-            for (std::size_t d = 0; d < div; d++) {
-                thr[d] = dis(gen);
-                sum += thr[d];
-            }
+        std::mt19937 seedGen0(seed);
+        std::mt19937 seedGen1(seedGen0() ^ disc);
+        std::mt19937 gen(seedGen1() ^ var);
+        std::uniform_real_distribution<double> dis(1.0 - range, 1.0 + range);
 
-            sum += dis(gen);
+        for (std::size_t d = 0; d < div; d++) {
+            thr[d] = dis(gen);
+            sum += thr[d];
         }
 
-        std::size_t done = 0;
+        sum += dis(gen);
+    }
+
+    std::size_t done = 0;
 
+    for (std::size_t d = 0; d < div; d++) {
+        done += std::lround(thr[d]/sum * length);
+        if (done >= length) done = length-1;
+        ranks[d] = done;
+    }
+
+    delete[] thr;
+}
+
+// Only the order statistics used as thresholds are needed, so instead of
+// sorting the column it is partitioned around each of the (sorted, unique)
+// ranks, splitting the rank set in half at every level.
+static void multiSelect(float *data,
+                        std::size_t begin,
+                        std::size_t end,
+                        const std::size_t *rbegin,
+                        const std::size_t *rend) {
+    if (rbegin == rend) return;
+
+    const std::size_t *mid = rbegin + (rend - rbegin) / 2;
+    std::nth_element(data + begin, data + *mid, data + end);
+    multiSelect(data, begin, *mid, rbegin, mid);
+    multiSelect(data, *mid + 1, end, mid + 1, rend);
+}
+
+// Thresholds are nondecreasing, so a value falls into the bucket given by
+// the number of thresholds below it. Few thresholds are compared one by one
+// across the whole column, which vectorizes; many are binary searched
+// without branches in a table padded to a power of two with infinities.
+// Values are compared in single precision, as the thresholds are.
+static void bucketize(const double *in_data,
+                      std::size_t length,
+                      const float *thr,
+                      std::size_t div,
+                      uint8_t *out_data) {
+    if (div < 16) {
+        std::memset(out_data, 0, length);
         for (std::size_t d = 0; d < div; d++) {
-            done += std::lround(thr[d]/sum * length);
-            if (done >= length) done = length-1;
-            thr[d] = sorted_in_data[done];
+            const float t = thr[d];
+            for (std::size_t i = 0; i < length; i++) {
+                out_data[i] += (float)in_data[i] > t;
+            }
         }
+        return;
     }
 
+    std::size_t size = 1;
+    while (size < div) size <<= 1;
+    std::vector<float> table(size, std::numeric_limits<float>::infinity());
+    std::copy(thr, thr + div, table.begin());
+
     for (std::size_t i = 0; i < length; i++) {
-        out_data[i] = 0;
-        for (std::size_t d = 0; d < div; d++) {
-            out_data[i] += in_data[i] > thr[d];
+        const float x = (float)in_data[i];
+        std::size_t b = 0;
+        for (std::size_t step = size >> 1; step > 0; step >>= 1) {
+            b += (x > table[b + step - 1]) * step;
         }
+        b += x > table[b];
+        out_data[i] = b;
     }
-
-    delete[] thr;
 }
 
-void discretizeVar(DataFile *in,
+// Values are written straight into the layout of the file: with lanes > 1
+// the buckets of a discretization go to its lane of the interleaved column,
+// which is packed once all of its discretizations are done.
+void discretizeVar(const DataFile *in,
                    DiscretizedFile *out,
                    int var,
-                   DiscretizationInfo info) {
-    float *in_data = in->getV(var);
-    std::vector<float> sorted_in_data(in_data, in_data + in->info.objectCount);
-    std::sort(sorted_in_data.begin(), sorted_in_data.end());
-    for (int d = 0; d < info.disc; d ++) {
-        discretize(info.seed, d, var, info.div, in->info.objectCount, in_data, sorted_in_data, out->getVD(var, d), info.range);
+                   DiscretizationInfo info,
+                   std::vector<float> &selected,
+                   std::vector<uint8_t> &buckets,
+                   std::vector<uint8_t> &values) {
+    const std::size_t length = in->info.objectCount;
+    const int lanes = out->info.lanes;
+    const double *in_data = in->getV(var);
+
+    std::vector<std::size_t> ranks((std::size_t)info.disc * info.div);
+    for (int d = 0; d < info.disc; d++) {
+        thresholdRanks(info.seed, d, var, info.div, length, info.range, ranks.data() + (std::size_t)d * info.div);
+    }
+
+    std::vector<std::size_t> wanted(ranks);
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+
+    selected.assign(in_data, in_data + length);
+    multiSelect(selected.data(), 0, length, wanted.data(), wanted.data() + wanted.size());
+
+    std::vector<float> thr(info.div);
+    for (int d = 0; d < info.disc; d++) {
+        for (int i = 0; i < info.div; i++) {
+            thr[i] = selected[ranks[(std::size_t)d * info.div + i]];
+        }
+        bucketize(in_data, length, thr.data(), info.div, lanes == 1 ? values.data() : buckets.data());
+        if (lanes > 1) {
+            for (std::size_t o = 0; o < length; o++) {
+                values[o * lanes + d % lanes] = buckets[o];
+            }
+        }
+        if (d % lanes == lanes - 1) {
+            packColumn(out->info.storage, values.data(), length * lanes, out->getVD(var, d));
+        }
     }
 }
 
-void discretizeFile(DataFile *in,
+void discretizeFile(const DataFile *in,
                     DiscretizedFile *out,
                     DiscretizationInfo info) {
-    memcpy(out->decision, in->decision, sizeof(int) * in->info.objectCount);
-    for (int v = 0; v < in->info.variableCount; v++) {
-        discretizeVar(in, out, v, info);
+    std::copy(in->decision, in->decision + in->info.objectCount, out->decision.begin());
+
+    #pragma omp parallel
+    {
+        std::vector<float> selected;
+        std::vector<uint8_t> buckets(in->info.objectCount);
+        std::vector<uint8_t> values((std::size_t)in->info.objectCount * out->info.lanes);
+
+        #pragma omp for schedule(dynamic)
+        for (int v = 0; v < in->info.variableCount; v++) {
+            discretizeVar(in, out, v, info, selected, buckets, values);
+        }
     }
 }
@@ -15,7 +15,7 @@ public:
     float range;
 };
 
-void discretizeFile(DataFile *in,
+void discretizeFile(const DataFile *in,
                     DiscretizedFile *out,
                     DiscretizationInfo info);
 
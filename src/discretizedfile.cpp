@@ -1,25 +1,184 @@
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include "discretizedfile.h"
 
 
-DiscretizedFileInfo::DiscretizedFileInfo(int d, int o, int v) :
+DiscretizedFileInfo::DiscretizedFileInfo(int d, int o, int v, int div, int lanes) :
         discretizations(d),
         objectCount(o),
-        variableCount(v) {}
+        variableCount(v),
+        divisions(div),
+        lanes(lanes),
+        storage(div == 1 ? DiscretizedStorage::Bit :
+                div < 16 ? DiscretizedStorage::Nibble : DiscretizedStorage::Byte) {}
 
-DiscretizedFile::DiscretizedFile(DiscretizedFileInfo dfi) : info(dfi) {}
-DiscretizedFile::~DiscretizedFile() {}
+// Columns are padded to whole cache lines
+std::size_t DiscretizedFileInfo::columnBytes(int values) {
+    std::size_t bytes;
+    switch (this->storage) {
+        case DiscretizedStorage::Bit:
+            bytes = (values + 7) / 8;
+            break;
+        case DiscretizedStorage::Nibble:
+            bytes = (values + 1) / 2;
+            break;
+        case DiscretizedStorage::Byte:
+        default:
+            bytes = values;
+            break;
+    }
+    return (bytes + 63) / 64 * 64;
+}
+
+std::size_t DiscretizedFileInfo::variableBytes() {
+    return this->columnBytes(this->objectCount * this->lanes) * (this->discretizations / this->lanes);
+}
+
+void packColumn(DiscretizedStorage storage, const uint8_t *values, int count, uint8_t *column) {
+    switch (storage) {
+        case DiscretizedStorage::Bit:
+            std::memset(column, 0, (count + 7) / 8);
+            for (int i = 0; i < count; i++) {
+                column[i >> 3] |= values[i] << (i & 7);
+            }
+            break;
+        case DiscretizedStorage::Nibble:
+            for (int i = 0; i < count; i += 2) {
+                uint8_t hi = i + 1 < count ? values[i + 1] : 0;
+                column[i >> 1] = values[i] | (hi << 4);
+            }
+            break;
+        case DiscretizedStorage::Byte:
+            std::memcpy(column, values, count);
+            break;
+    }
+}
+
+// Header of a discretized file; the decision follows it
+struct DiscretizedFileHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t discretizations;
+    int32_t objectCount;
+    int32_t variableCount;
+    int32_t divisions;
+    int32_t lanes;
+    uint64_t dataHash;
+    uint32_t seed;
+    float range;
+};
+
+static const char DISCRETIZED_FILE_MAGIC[8] = {'C', 'u', 'C', 'u', 'b', 'e', 's', 'D'};
+static const uint32_t DISCRETIZED_FILE_VERSION = 2;
+static const std::size_t DISCRETIZED_FILE_PAGE = 4096;
+
+static std::size_t columnsOffset(const DiscretizedFileInfo &info) {
+    std::size_t offset = sizeof(DiscretizedFileHeader) + sizeof(int32_t) * info.objectCount;
+    return (offset + DISCRETIZED_FILE_PAGE - 1) / DISCRETIZED_FILE_PAGE * DISCRETIZED_FILE_PAGE;
+}
 
+static std::size_t fileBytes(DiscretizedFileInfo info) {
+    return columnsOffset(info) + info.variableBytes() * info.variableCount;
+}
+
+static DiscretizedFileHeader fileHeader(const DiscretizedFileInfo &info, const DiscretizedSource &source) {
+    DiscretizedFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, DISCRETIZED_FILE_MAGIC, sizeof(header.magic));
+    header.version = DISCRETIZED_FILE_VERSION;
+    header.discretizations = info.discretizations;
+    header.objectCount = info.objectCount;
+    header.variableCount = info.variableCount;
+    header.divisions = info.divisions;
+    header.lanes = info.lanes;
+    header.dataHash = source.dataHash;
+    header.seed = source.seed;
+    header.range = source.range;
+    return header;
+}
+
+DiscretizedFile::DiscretizedFile(DiscretizedFileInfo dfi) : info(dfi), columns(nullptr) {}
+
+// The bitset kernel reads Bit columns as 64-bit words, so the data is
+// allocated as such (columns are whole cache lines anyway)
 void DiscretizedFile::allocate() {
-    this->data = new int32_t[this->info.discretizations * this->info.objectCount * this->info.variableCount];
-    this->decision = new int[this->info.objectCount];
+    std::size_t size = this->info.variableBytes() * this->info.variableCount;
+    this->data.assign(size / sizeof(uint64_t), 0);
+    this->decision.assign(this->info.objectCount, 0);
+    this->columns = reinterpret_cast<uint8_t *>(this->data.data());
+}
+
+bool DiscretizedFile::create(const char *path) {
+    this->path = path;
+    this->file.reset(new MappedFile());
+    if (!this->file->create((this->path + ".part").c_str(), fileBytes(this->info))) {
+        this->file.reset();
+        return false;
+    }
+    this->decision.assign(this->info.objectCount, 0);
+    this->columns = static_cast<uint8_t *>(this->file->data()) + columnsOffset(this->info);
+    return true;
 }
 
-int32_t * DiscretizedFile::getVD(int v, int d) {
-    std::size_t offset  = this->info.objectCount;
-           offset *= (v * this->info.discretizations + d);
-    return this->data + offset;
+bool DiscretizedFile::save(const DiscretizedSource &source) {
+    if (!this->mapped())
+        return false;
+    uint8_t *base = static_cast<uint8_t *>(this->file->data());
+    std::copy(this->decision.begin(), this->decision.end(),
+              reinterpret_cast<int32_t *>(base + sizeof(DiscretizedFileHeader)));
+
+    DiscretizedFileHeader header = fileHeader(this->info, source);
+    std::memcpy(base, &header, sizeof(header));
+    std::string part = this->path + ".part";
+    if (this->file->sync() && std::rename(part.c_str(), this->path.c_str()) == 0)
+        return true;
+    // the mapping stays valid, only the file is gone
+    std::remove(part.c_str());
+    return false;
+}
+
+bool DiscretizedFile::open(const char *path, const DiscretizedSource &source) {
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(path) || file->size() != fileBytes(this->info))
+        return false;
+
+    const uint8_t *base = static_cast<const uint8_t *>(file->data());
+    DiscretizedFileHeader header = fileHeader(this->info, source);
+    if (std::memcmp(base, &header, sizeof(header)) != 0)
+        return false;
+
+    const int32_t *decision = reinterpret_cast<const int32_t *>(base + sizeof(DiscretizedFileHeader));
+    this->decision.assign(decision, decision + this->info.objectCount);
+    this->path = path;
+    this->file = std::move(file);
+    this->columns = static_cast<uint8_t *>(this->file->data()) + columnsOffset(this->info);
+    return true;
+}
+
+bool DiscretizedFile::mapped() const {
+    return this->file != nullptr;
+}
+
+uint8_t * DiscretizedFile::getVD(int v, int d) {
+    std::size_t offset  = this->info.variableBytes() * v;
+                offset += this->info.columnBytes(this->info.objectCount * this->info.lanes) * (d / this->info.lanes);
+    return this->columns + offset;
+}
+
+int DiscretizedFile::get(int v, int d, int o) {
+    int i = o * this->info.lanes + d % this->info.lanes;
+    switch (this->info.storage) {
+        case DiscretizedStorage::Bit:
+            return discretizedValue<DiscretizedStorage::Bit>(this->getVD(v, d), i);
+        case DiscretizedStorage::Nibble:
+            return discretizedValue<DiscretizedStorage::Nibble>(this->getVD(v, d), i);
+        case DiscretizedStorage::Byte:
+        default:
+            return discretizedValue<DiscretizedStorage::Byte>(this->getVD(v, d), i);
+    }
 }
 
 int DiscretizedFile::c1() {
@@ -37,3 +196,17 @@ int DiscretizedFile::c0() {
             c0++;
     return c0;
 }
+
+int DiscretizedFile::classes() {
+    int classes = 2;
+    for (int i = 0; i < this->info.objectCount; ++i)
+        classes = std::max(classes, this->decision[i] + 1);
+    return classes;
+}
+
+std::vector<int> DiscretizedFile::classCounts() {
+    std::vector<int> counts(this->classes());
+    for (int i = 0; i < this->info.objectCount; ++i)
+        counts[this->decision[i]]++;
+    return counts;
+}
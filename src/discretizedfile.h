@@ -1,30 +1,98 @@
 #ifndef DISCRETIZEDFILE_H
 #define DISCRETIZEDFILE_H
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Discretized values are in [0, DIV], so they are stored packed:
+// eight per byte (lowest bit first) when DIV = 1, two per byte (low nibble
+// first) when DIV < 16, one per byte otherwise.
+
+enum class DiscretizedStorage { Bit, Nibble, Byte };
 
 class DiscretizedFileInfo {
 public:
-    DiscretizedFileInfo(int d, int o, int v);
+    DiscretizedFileInfo(int d, int o, int v, int div, int lanes = 1);
     int discretizations;
     int objectCount;
     int variableCount;
+    int divisions;
+    int lanes;
+    DiscretizedStorage storage;
+    std::size_t columnBytes(int values);
+    std::size_t variableBytes();
+};
+
+template <DiscretizedStorage S>
+inline int discretizedValue(const uint8_t *column, int i);
+
+template <>
+inline int discretizedValue<DiscretizedStorage::Bit>(const uint8_t *column, int i) {
+    return (column[i >> 3] >> (i & 7)) & 1;
+}
+
+template <>
+inline int discretizedValue<DiscretizedStorage::Byte>(const uint8_t *column, int i) {
+    return column[i];
+}
+
+template <>
+inline int discretizedValue<DiscretizedStorage::Nibble>(const uint8_t *column, int i) {
+    return (column[i >> 1] >> ((i & 1) << 2)) & 0xF;
+}
+
+void packColumn(DiscretizedStorage storage, const uint8_t *values, int count, uint8_t *column);
+
+// What a discretized file was computed from, besides its info: the data
+// (by a hash of its content) and the discretization parameters
+
+struct DiscretizedSource {
+    uint64_t dataHash;
+    uint32_t seed;
+    float range;
 };
 
-// Stored in VDO way
+// Stored in VDO way. With lanes > 1 every column holds that many
+// consecutive discretizations, interleaved for every object, which is what
+// the vector kernels load; discretizations must then be a multiple of lanes.
+//
+// The columns are either allocated in memory or, for data that does not
+// fit in RAM, in a mapped file (create), which is laid out as
+//
+//   header | decision | columns (from a page boundary, as in memory)
+//
+// It is written under a temporary name and gets its own once save() has
+// written the header, so mappings of an older file at that path stay valid;
+// if that fails the temporary file is removed (the columns stay mapped).
+// open() maps a saved file, provided it has the same info and source.
 
 class DiscretizedFile {
 
 public:
     DiscretizedFile(DiscretizedFileInfo dfi);
-    ~DiscretizedFile();
     DiscretizedFileInfo info;
     void allocate();
-    int32_t * data;
-    int * decision;
-    int32_t * getVD(int v, int d);
+    bool create(const char *path);
+    bool save(const DiscretizedSource &source);
+    bool open(const char *path, const DiscretizedSource &source);
+    bool mapped() const;
+    std::vector<int> decision;
+    uint8_t * getVD(int v, int d);      // column holding discretization d
+    int get(int v, int d, int o);
     int c1();
     int c0();
+    int classes();                  // decision classes 0, 1, ..., at least two
+    std::vector<int> classCounts(); // objects of every class
+private:
+    std::vector<uint64_t> data;
+    std::unique_ptr<MappedFile> file;
+    std::string path;
+    uint8_t * columns;
 };
 
 #endif
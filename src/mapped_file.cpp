@@ -0,0 +1,81 @@
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : addr(nullptr), bytes(0) {}
+
+MappedFile::~MappedFile() {
+    this->close();
+}
+
+// The file is created (or truncated) with the given size, filled with zeros
+bool MappedFile::create(const char *path, std::size_t bytes) {
+#ifndef _WIN32
+    this->close();
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    void *addr = MAP_FAILED;
+    if (::ftruncate(fd, bytes) == 0)
+        addr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    this->addr = addr;
+    this->bytes = bytes;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MappedFile::open(const char *path) {
+#ifndef _WIN32
+    this->close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    void *addr = MAP_FAILED;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    this->addr = addr;
+    this->bytes = st.st_size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MappedFile::sync() {
+#ifndef _WIN32
+    return this->addr != nullptr && ::msync(this->addr, this->bytes, MS_SYNC) == 0;
+#else
+    return false;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (this->addr != nullptr)
+        ::munmap(this->addr, this->bytes);
+#endif
+    this->addr = nullptr;
+    this->bytes = 0;
+}
+
+void * MappedFile::data() {
+    return this->addr;
+}
+
+std::size_t MappedFile::size() const {
+    return this->bytes;
+}
@@ -0,0 +1,28 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+
+// A file mapped into memory and shared with it: written pages go back to
+// the file, so the OS can page them out instead of keeping them in RAM.
+// Files written elsewhere are mapped read-only (open). Mapping needs POSIX;
+// elsewhere create() and open() fail.
+
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    bool create(const char *path, std::size_t bytes);
+    bool open(const char *path);
+    bool sync();
+    void close();
+    void * data();
+    std::size_t size() const;
+private:
+    void * addr;
+    std::size_t bytes;
+};
+
+#endif
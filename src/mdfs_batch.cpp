@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "mdfs_batch.h"
+#include "mdfs_scheme.h"
+#include "stats.h"
+
+ObjectBatch::ObjectBatch(int objects, int size, int classes, int planes) :
+    objects(objects), size(size), classes(classes), planes(planes),
+    values((std::size_t)objects * size), plane(objects), class_counts(size, std::vector<int>(classes)) {}
+
+ObjectBatch ObjectBatch::decisions(int objects, int size, const int *decisions) {
+    ObjectBatch batch(objects, size, 2, 1);
+    for (int j = 0; j < size; j++) {
+        for (int o = 0; o < objects; o++) {
+            const int y = decisions[(std::size_t)j * objects + o] == 1;
+            batch.values[(std::size_t)o * size + j] = y;
+            batch.class_counts[j][y]++;
+        }
+    }
+    return batch;
+}
+
+ObjectBatch ObjectBatch::replicates(int objects, int size, const int *weights,
+                                    const std::vector<int> &decision, int classes) {
+    ObjectBatch batch(objects, size, classes, classes);
+    batch.plane = decision;
+    for (int j = 0; j < size; j++) {
+        for (int o = 0; o < objects; o++) {
+            const int w = weights[(std::size_t)j * objects + o];
+            batch.values[(std::size_t)o * size + j] = w;
+            batch.class_counts[j][decision[o]] += w;
+        }
+    }
+    return batch;
+}
+
+bool ObjectBatch::weighted() const {
+    return planes == classes;
+}
+
+// The entropy tables depend on a column only by its class counts, which
+// the permutations of a decision share, so columns share them. A column of
+// weights counts as their sum of objects.
+
+ColumnTables::ColumnTables(const ObjectBatch &batch, float pseudo, int div, int dim) : table(batch.size) {
+    std::map<std::vector<int>, int> table_of_counts;
+    for (int j = 0; j < batch.size; j++) {
+        const std::vector<int> &counts = batch.class_counts[j];
+        if (table_of_counts.find(counts) == table_of_counts.end()) {
+            table_of_counts[counts] = tables.size();
+            tables.emplace_back(counts, pseudo, div, dim);
+        }
+        table[j] = table_of_counts[counts];
+    }
+}
+
+// Bucket indices of the first dim variables of the tuple, in the digits of
+// the other kernels (the first variable is the least significant one)
+template <DiscretizedStorage S>
+static void prefixBuckets(DiscretizedFile *in, const VarsTuple &v, int dim, int d, int div, uint32_t *prefix) {
+    const int objects = in->info.objectCount;
+    const int lanes = in->info.lanes;
+    std::fill(prefix, prefix + objects, 0);
+    for (int vv = dim - 1; vv >= 0; vv--) {
+        const uint8_t *col = in->getVD(v.get(vv), d);
+        for (int o = 0; o < objects; o++)
+            prefix[o] = prefix[o] * (div + 1) + discretizedValue<S>(col, o * lanes + d % lanes);
+    }
+}
+
+// Every object adds its row of values to the counters of its plane and
+// bucket, a contiguous row of the block of columns [j0, j0 + jn), so the
+// loop over columns is vectorized.
+
+static void countBlock(const ObjectBatch &batch,
+                       const uint32_t *buckets,
+                       int cells,
+                       int j0,
+                       int jn,
+                       uint32_t *counts) {
+    std::fill(counts, counts + (std::size_t)batch.planes * cells * jn, 0);
+    for (int o = 0; o < batch.objects; o++) {
+        const uint16_t *y = batch.values.data() + (std::size_t)o * batch.size + j0;
+        uint32_t *n = counts + ((std::size_t)batch.plane[o] * cells + buckets[o]) * jn;
+        #pragma omp simd
+        for (int j = 0; j < jn; j++)
+            n[j] += y[j];
+    }
+}
+
+// Counters of every class of the column j of the block, in planes as the
+// other kernels have them; class 0 of decisions is the rest of the totals
+static void columnCounters(const ObjectBatch &batch,
+                           const uint32_t *totals,
+                           const uint32_t *counts,
+                           int cells,
+                           int j,
+                           int jn,
+                           uint32_t *counters) {
+    if (batch.weighted()) {
+        for (int c = 0; c < batch.classes * cells; c++)
+            counters[c] = counts[(std::size_t)c * jn + j];
+    } else {
+        for (int b = 0; b < cells; b++) {
+            counters[cells + b] = counts[(std::size_t)b * jn + j];
+            counters[b] = totals[b] - counters[cells + b];
+        }
+    }
+}
+
+static int columnBlock(const ObjectBatch &batch, int cells) {
+    return std::max(1, std::min(batch.size, (int)(BATCH_COUNTER_BYTES / sizeof(uint32_t) / cells / batch.planes)));
+}
+
+// Dense tables of the columns, counted a block of columns at a time when
+// the first column of the block is selected
+
+namespace {
+
+template <DiscretizedStorage S>
+class BatchCounter {
+public:
+    BatchCounter(const AlgInfo &ai, DiscretizedFile *in, const ObjectBatch &batch, const ColumnTables &tables) :
+        in(in),
+        batch(&batch),
+        tables(&tables),
+        dim(ai.DIM),
+        div(ai.DIV),
+        objects(in->info.objectCount),
+        lanes(in->info.lanes),
+        cc(cellCount(ai.DIV, ai.DIM)),
+        cd(cc / (ai.DIV + 1)),
+        tuple_block(columnBlock(batch, cc)),
+        subtuple_block(columnBlock(batch, cd)),
+        prefixes((std::size_t)ai.DISC * objects),
+        buckets(objects),
+        totals(cc),
+        counts((std::size_t)batch.planes * std::max((std::size_t)cc * tuple_block, (std::size_t)cd * subtuple_block)),
+        counters(batch.classes * cc),
+        reduced(batch.classes * cd),
+        cells(cc),
+        block(tuple_block),
+        j0(0),
+        jn(0),
+        j(0) {}
+
+    int columns() const {
+        return batch->size;
+    }
+
+    void computePrefix(const VarsTuple &v, int d) {
+        prefixBuckets<S>(in, v, dim - 1, d, div, prefixes.data() + (std::size_t)d * objects);
+    }
+
+    void countTuple(const VarsTuple &v, int d) {
+        const uint32_t *prefix = prefixes.data() + (std::size_t)d * objects;
+        const uint8_t *last = in->getVD(v.get(dim - 1), d);
+        std::fill(totals.begin(), totals.end(), 0);
+        for (int o = 0; o < objects; o++) {
+            buckets[o] = prefix[o] + discretizedValue<S>(last, o * lanes + d % lanes) * cd;
+            totals[buckets[o]]++;
+        }
+        cells = cc;
+        block = tuple_block;
+        jn = 0;
+    }
+
+    void countSubtuple(const VarsTuple &s, int d) {
+        prefixBuckets<S>(in, s, dim - 1, d, div, buckets.data());
+        std::fill(totals.begin(), totals.begin() + cd, 0);
+        for (int o = 0; o < objects; o++)
+            totals[buckets[o]]++;
+        cells = cd;
+        block = subtuple_block;
+        jn = 0;
+    }
+
+    void selectColumn(int column) {
+        if (jn == 0 || column >= j0 + jn) {
+            j0 = column;
+            jn = std::min(block, batch->size - j0);
+            countBlock(*batch, buckets.data(), cells, j0, jn, counts.data());
+        }
+        columnCounters(*batch, totals.data(), counts.data(), cells, column - j0, jn, counters.data());
+        j = column;
+    }
+
+    float informationGain() {
+        return (*tables)[j].full.informationGain(cc, counters.data());
+    }
+
+    float marginalInformationGain(int vv) {
+        for (int k = 0; k < batch->classes; k++) {
+            reduceCounter(div, counters.data() + k * cc, dim, reduced.data() + k * cd, vv + 1);
+        }
+        return (*tables)[j].marginal.informationGain(cd, reduced.data());
+    }
+
+    float subtupleInformationGain() {
+        return (*tables)[j].marginal.informationGain(cd, counters.data());
+    }
+
+private:
+    DiscretizedFile *in;
+    const ObjectBatch *batch;
+    const ColumnTables *tables;
+    const int dim;
+    const int div;
+    const int objects;
+    const int lanes;
+    const int cc;
+    const int cd;
+    const int tuple_block;
+    const int subtuple_block;
+    std::vector<uint32_t> prefixes;
+    std::vector<uint32_t> buckets;
+    std::vector<uint32_t> totals;
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> counters;
+    std::vector<uint32_t> reduced;
+    int cells;
+    int block;
+    int j0;
+    int jn;
+    int j;
+};
+
+}
+
+template <DiscretizedStorage S>
+static void batchMdfs(const AlgInfo &ai,
+                      DiscretizedFile *in,
+                      const ObjectBatch &batch,
+                      MDFSOutput &out) {
+    const ColumnTables tables(batch, ai.pseudo, ai.DIV, ai.DIM);
+    mdfs_scheme(ai, in, BatchCounter<S>(ai, in, batch, tables), out);
+}
+
+void BatchMDFS(const AlgInfo &ai,
+               DiscretizedFile *in,
+               const ObjectBatch &batch,
+               MDFSOutput &out) {
+    switch (in->info.storage) {
+        case DiscretizedStorage::Bit:
+            batchMdfs<DiscretizedStorage::Bit>(ai, in, batch, out);
+            break;
+        case DiscretizedStorage::Nibble:
+            batchMdfs<DiscretizedStorage::Nibble>(ai, in, batch, out);
+            break;
+        case DiscretizedStorage::Byte:
+            batchMdfs<DiscretizedStorage::Byte>(ai, in, batch, out);
+            break;
+    }
+}
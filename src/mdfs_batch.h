@@ -0,0 +1,73 @@
+#ifndef MDFS_BATCH
+#define MDFS_BATCH
+
+#include <cstdint>
+#include <vector>
+
+#include "mdfs_common.h"
+
+// Columns of counts of the same objects, counted together: every object adds
+// its row of values (values[o * size + j]) to the counters of the plane
+// plane[o] of its bucket, for all the columns at once.
+//  - decisions: any number of 0/1 decisions, e.g. permutations of one for a
+//    null distribution; there is one plane, of class 1, and the values are
+//    the decisions; class 0 has the rest of the objects of a bucket
+//  - replicates: integer weights of the objects for the decision of the data,
+//    e.g. bootstrap replicates; the planes are the classes of the objects and
+//    the values are the weights, so an object counts as that many of them
+
+class ObjectBatch {
+    ObjectBatch(int objects, int size, int classes, int planes);
+public:
+    static ObjectBatch decisions(int objects, int size, const int *decisions);     // by columns, as in R
+    static ObjectBatch replicates(int objects, int size, const int *weights,       // by columns, as in R
+                                  const std::vector<int> &decision, int classes);
+    const int objects;
+    const int size;
+    const int classes;
+    const int planes;
+    std::vector<uint16_t> values;
+    std::vector<int> plane;
+    std::vector<std::vector<int>> class_counts;   // of every column, weighted
+    bool weighted() const;
+};
+
+// Weights of the replicates fit the values
+const int BATCH_MAX_WEIGHT = UINT16_MAX;
+
+// Counters of a block of columns are kept to this many bytes
+const std::size_t BATCH_COUNTER_BYTES = std::size_t(1) << 18;
+
+// Every column of other class counts has a full and a marginal entropy
+// table, of a term per class and one for the sum for each count up to its
+// (weighted) total. Replicates are refused above this many bytes of them.
+const double BATCH_TABLE_BYTES = double(1 << 30);
+
+inline double batchTableBytes(int classes, double total) {
+    return 2.0 * (classes + 1) * (total + 1) * sizeof(float);
+}
+
+// Entropy tables of every column, tables[table[j]]; the columns of the
+// same class counts share them
+
+class ColumnTables {
+public:
+    ColumnTables(const ObjectBatch &batch, float pseudo, int div, int dim);
+    const DecisionTables &operator[](int j) const { return tables[table[j]]; }
+private:
+    std::vector<DecisionTables> tables;
+    std::vector<int> table;
+};
+
+// Max IGs for every column of the batch in one walk of the tuples: the
+// bucket of an object is found once per tuple and discretization, for all
+// the columns. The output is of BatchMaxIGs. The kernel reads any storage
+// and lanes; the launcher hands mostly empty tables to SparseBatchMDFS and
+// decisions of binary discretizations to BitsetBatchMDFS instead.
+
+void BatchMDFS(const AlgInfo &ai,
+               DiscretizedFile *in,
+               const ObjectBatch &batch,
+               MDFSOutput &out);
+
+#endif
@@ -0,0 +1,308 @@
+#include <cstring>
+#include <vector>
+
+#include "mdfs_bitset.h"
+#include "mdfs_scheme.h"
+#include "stats.h"
+
+// Counts the 2^DIM x 2 contingency table of a tuple with AND/ANDNOT and popcount:
+// the masks of both decision classes are split on every variable of the tuple,
+// so that mask[p] selects objects whose bit pattern over the tuple equals p
+// (that is, the bucket index b = p used by the other kernels).
+static inline void bitsetCounters(int dim,
+                                  int words,
+                                  const uint64_t * const *cols,
+                                  const uint64_t *dec0,
+                                  const uint64_t *dec1,
+                                  uint64_t *masks,
+                                  uint32_t *n) {
+    const int cc = 1 << dim;
+    uint64_t *m0 = masks;
+    uint64_t *m1 = masks + cc;
+
+    std::memset(n, 0, sizeof(uint32_t) * cc * 2);
+
+    for (int w = 0; w < words; ++w) {
+        m0[0] = dec0[w];
+        m1[0] = dec1[w];
+        for (int vv = 0; vv < dim; vv++) {
+            const uint64_t col = cols[vv][w];
+            const int size = 1 << vv;
+            for (int p = 0; p < size; p++) {
+                m0[p | size] = m0[p] & col;
+                m0[p] &= ~col;
+                m1[p | size] = m1[p] & col;
+                m1[p] &= ~col;
+            }
+        }
+        for (int p = 0; p < cc; p++) {
+            n[p] += __builtin_popcountll(m0[p]);
+            n[cc + p] += __builtin_popcountll(m1[p]);
+        }
+    }
+}
+
+// Bit columns of DiscretizedFile hold 64 objects per word, lowest bit first
+// and padded with zeros to whole cache lines, so they are read as words.
+// The decision is split into the masks of both classes.
+
+namespace {
+
+class DecisionBits {
+public:
+    DecisionBits(DiscretizedFile *in) :
+            words((in->info.objectCount + 63) / 64),
+            dec0(words, 0),
+            dec1(words, 0) {
+        for (int o = 0; o < in->info.objectCount; ++o) {
+            if (in->decision[o] == 1)
+                dec1[o / 64] |= (uint64_t)1 << (o % 64);
+            else
+                dec0[o / 64] |= (uint64_t)1 << (o % 64);
+        }
+    }
+    const int words;
+    std::vector<uint64_t> dec0;
+    std::vector<uint64_t> dec1;
+};
+
+inline const uint64_t *bitColumn(DiscretizedFile *in, int v, int d) {
+    return reinterpret_cast<const uint64_t *>(in->getVD(v, d));
+}
+
+// Counts the whole table of every tuple, there is no prefix to keep
+
+class BitsetCounter {
+public:
+    BitsetCounter(const AlgInfo &ai, DiscretizedFile *in, const DecisionBits &bits, const DecisionTables &tables) :
+        in(in),
+        bits(&bits),
+        tables(&tables),
+        dim(ai.DIM),
+        cc(1 << ai.DIM),
+        cd(cc / 2),
+        counters(2 * cc),
+        reduced(2 * cd),
+        masks(2 * cc),
+        cols(ai.DIM) {}
+
+    int columns() const {
+        return 1;
+    }
+
+    void selectColumn(int) {}
+
+    void computePrefix(const VarsTuple &, int) {}
+
+    void countTuple(const VarsTuple &v, int d) {
+        for (int vv = 0; vv < dim; vv++) {
+            cols[vv] = bitColumn(in, v.get(vv), d);
+        }
+        bitsetCounters(dim, bits->words, cols.data(), bits->dec0.data(), bits->dec1.data(), masks.data(), counters.data());
+    }
+
+    float informationGain() {
+        return tables->full.informationGain(cc, counters.data(), counters.data() + cc);
+    }
+
+    float marginalInformationGain(int vv) {
+        reduceCounter(1, counters.data(), dim, reduced.data(), vv + 1);
+        reduceCounter(1, counters.data() + cc, dim, reduced.data() + cd, vv + 1);
+        return tables->marginal.informationGain(cd, reduced.data(), reduced.data() + cd);
+    }
+
+    void countSubtuple(const VarsTuple &s, int d) {
+        for (int vv = 0; vv < dim - 1; vv++) {
+            cols[vv] = bitColumn(in, s.get(vv), d);
+        }
+        bitsetCounters(dim - 1, bits->words, cols.data(), bits->dec0.data(), bits->dec1.data(), masks.data(), counters.data());
+    }
+
+    float subtupleInformationGain() {
+        return tables->marginal.informationGain(cd, counters.data(), counters.data() + cd);
+    }
+
+private:
+    DiscretizedFile *in;
+    const DecisionBits *bits;
+    const DecisionTables *tables;
+    const int dim;
+    const int cc;
+    const int cd;
+    std::vector<uint32_t> counters;
+    std::vector<uint32_t> reduced;
+    std::vector<uint64_t> masks;
+    std::vector<const uint64_t*> cols;
+};
+
+// Class 1 of every column of a batch of decisions, as masks of words,
+// with the mask of all the objects
+
+class BatchBits {
+public:
+    BatchBits(const ObjectBatch &batch) :
+            words((batch.objects + 63) / 64),
+            size(batch.size),
+            objects(words, 0),
+            dec1((std::size_t)batch.size * words, 0) {
+        for (int o = 0; o < batch.objects; ++o) {
+            const uint64_t bit = (uint64_t)1 << (o % 64);
+            objects[o / 64] |= bit;
+            for (int j = 0; j < size; j++) {
+                if (batch.values[(std::size_t)o * size + j])
+                    dec1[(std::size_t)j * words + o / 64] |= bit;
+            }
+        }
+    }
+    const int words;
+    const int size;
+    std::vector<uint64_t> objects;
+    std::vector<uint64_t> dec1;     // of column j from j * words
+};
+
+// Splits the mask of all the objects on dim variables, so that
+// masks[p * words + w] selects the objects of the bit pattern p over them
+inline void splitMasks(int dim,
+                       int words,
+                       const uint64_t * const *cols,
+                       const uint64_t *all,
+                       uint64_t *masks) {
+    for (int w = 0; w < words; ++w) {
+        masks[w] = all[w];
+        for (int vv = 0; vv < dim; vv++) {
+            const uint64_t col = cols[vv][w];
+            const int size = 1 << vv;
+            for (int p = 0; p < size; p++) {
+                masks[(p | size) * words + w] = masks[p * words + w] & col;
+                masks[p * words + w] &= ~col;
+            }
+        }
+    }
+}
+
+// The masks of the cells are found once for all the columns, those of the
+// prefix are kept and split on the last variable; the counter of class 1 of
+// a column is the popcount of a mask and of its decision.
+
+class BitsetBatchCounter {
+public:
+    BitsetBatchCounter(const AlgInfo &ai, DiscretizedFile *in, const BatchBits &bits, const ColumnTables &tables) :
+        in(in),
+        bits(&bits),
+        tables(&tables),
+        dim(ai.DIM),
+        cc(1 << ai.DIM),
+        cd(cc / 2),
+        words(bits.words),
+        prefixes((std::size_t)ai.DISC * cd * words),
+        masks((std::size_t)cc * words),
+        totals(cc),
+        counters(2 * cc),
+        reduced(2 * cd),
+        cols(ai.DIM),
+        cells(cc),
+        j(0) {}
+
+    int columns() const {
+        return bits->size;
+    }
+
+    void computePrefix(const VarsTuple &v, int d) {
+        for (int vv = 0; vv < dim - 1; vv++) {
+            cols[vv] = bitColumn(in, v.get(vv), d);
+        }
+        splitMasks(dim - 1, words, cols.data(), bits->objects.data(), prefixes.data() + (std::size_t)d * cd * words);
+    }
+
+    void countTuple(const VarsTuple &v, int d) {
+        const uint64_t *prefix = prefixes.data() + (std::size_t)d * cd * words;
+        const uint64_t *col = bitColumn(in, v.get(dim - 1), d);
+        for (int p = 0; p < cd; p++) {
+            for (int w = 0; w < words; ++w) {
+                masks[p * words + w] = prefix[p * words + w] & ~col[w];
+                masks[(p + cd) * words + w] = prefix[p * words + w] & col[w];
+            }
+        }
+        countTotals(cc);
+    }
+
+    void countSubtuple(const VarsTuple &s, int d) {
+        for (int vv = 0; vv < dim - 1; vv++) {
+            cols[vv] = bitColumn(in, s.get(vv), d);
+        }
+        splitMasks(dim - 1, words, cols.data(), bits->objects.data(), masks.data());
+        countTotals(cd);
+    }
+
+    void selectColumn(int column) {
+        const uint64_t *y = bits->dec1.data() + (std::size_t)column * words;
+        for (int p = 0; p < cells; p++) {
+            uint32_t n = 0;
+            for (int w = 0; w < words; ++w)
+                n += __builtin_popcountll(masks[p * words + w] & y[w]);
+            counters[cells + p] = n;
+            counters[p] = totals[p] - n;
+        }
+        j = column;
+    }
+
+    float informationGain() {
+        return (*tables)[j].full.informationGain(cc, counters.data());
+    }
+
+    float marginalInformationGain(int vv) {
+        reduceCounter(1, counters.data(), dim, reduced.data(), vv + 1);
+        reduceCounter(1, counters.data() + cc, dim, reduced.data() + cd, vv + 1);
+        return (*tables)[j].marginal.informationGain(cd, reduced.data());
+    }
+
+    float subtupleInformationGain() {
+        return (*tables)[j].marginal.informationGain(cd, counters.data());
+    }
+
+private:
+    void countTotals(int n) {
+        cells = n;
+        for (int p = 0; p < cells; p++) {
+            uint32_t t = 0;
+            for (int w = 0; w < words; ++w)
+                t += __builtin_popcountll(masks[p * words + w]);
+            totals[p] = t;
+        }
+    }
+
+    DiscretizedFile *in;
+    const BatchBits *bits;
+    const ColumnTables *tables;
+    const int dim;
+    const int cc;
+    const int cd;
+    const int words;
+    std::vector<uint64_t> prefixes;
+    std::vector<uint64_t> masks;
+    std::vector<uint32_t> totals;
+    std::vector<uint32_t> counters;
+    std::vector<uint32_t> reduced;
+    std::vector<const uint64_t*> cols;
+    int cells;
+    int j;
+};
+
+}
+
+void BitsetMDFS(const AlgInfo &ai,
+                DiscretizedFile *in,
+                MDFSOutput &out) {
+    const DecisionBits bits(in);
+    const DecisionTables tables(in->classCounts(), ai.pseudo, ai.DIV, ai.DIM);
+    mdfs_scheme(ai, in, BitsetCounter(ai, in, bits, tables), out);
+}
+
+void BitsetBatchMDFS(const AlgInfo &ai,
+                     DiscretizedFile *in,
+                     const ObjectBatch &batch,
+                     MDFSOutput &out) {
+    const BatchBits bits(batch);
+    const ColumnTables tables(batch, ai.pseudo, ai.DIV, ai.DIM);
+    mdfs_scheme(ai, in, BitsetBatchCounter(ai, in, bits, tables), out);
+}
@@ -0,0 +1,19 @@
+#ifndef MDFS_BITSET
+#define MDFS_BITSET
+
+#include "mdfs_batch.h"
+#include "mdfs_common.h"
+
+// Kernel for binary discretizations (DIV = 1 only, Bit storage)
+void BitsetMDFS(const AlgInfo &ai,
+                DiscretizedFile *in,
+                MDFSOutput &out);
+
+// The same for a batch of decisions (see BatchMDFS); the weights of
+// replicates are not bits, so they are counted by BatchMDFS
+void BitsetBatchMDFS(const AlgInfo &ai,
+                     DiscretizedFile *in,
+                     const ObjectBatch &batch,
+                     MDFSOutput &out);
+
+#endif
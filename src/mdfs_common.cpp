@@ -1,15 +1,151 @@
 #include <R.h>
 
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <numeric>
+
 #include "mdfs_common.h"
 
+#define CONTAINS(x, y) (std::find((x).begin(), (x).end(), (y)) != (x).end())
+
 
-VarsTuple::VarsTuple(int dim, int var_count) : dim(dim), var_count(var_count), v(dim+1) {
+VarsTuple::VarsTuple(int dim, int var_count) :
+        dim(dim), var_count(var_count), v(dim+1), anchors(nullptr), gaps(nullptr), anchor(0) {
     v[0] = 0;
     for (int d = 1; d <= dim; d++)
         v[d] = d - 1;
 }
 
+// Builds the tuple of the given rank in the lexicographic order of next()
+VarsTuple::VarsTuple(int dim, int var_count, std::size_t rank) :
+        dim(dim), var_count(var_count), v(dim+1), anchors(nullptr), gaps(nullptr), anchor(0) {
+    v[0] = 0;
+    if (rank >= count(dim, var_count)) {
+        v[0] = 1;
+        return;
+    }
+    unrank(dim, var_count, rank, v.data() + 1);
+}
+
+VarsTuple::VarsTuple(int dim, int var_count, std::vector<int> lo, std::vector<int> hi) :
+        dim(dim), var_count(var_count), v(dim+1), lo(lo), hi(hi), anchors(nullptr), gaps(nullptr), anchor(0) {
+    v[0] = 0;
+    v[1] = lo[0];
+    if (v[1] >= hi[0] || !fill(1))
+        v[0] = 1;
+}
+
+// Builds the anchored tuple of the given rank, anchor by anchor
+VarsTuple::VarsTuple(int dim, int var_count, const std::vector<int> &anchors, const std::vector<int> &gaps, std::size_t rank) :
+        dim(dim), var_count(var_count), v(dim+1), anchors(&anchors), gaps(&gaps), anchor(0), u(dim-1) {
+    v[0] = 0;
+    for (; anchor < (int)anchors.size(); anchor++) {
+        std::size_t with_anchor = anchoredCount(dim, var_count, anchor);
+        if (rank < with_anchor)
+            break;
+        rank -= with_anchor;
+    }
+    if (anchor == (int)anchors.size()) {
+        v[0] = 1;
+        return;
+    }
+    unrank(dim - 1, var_count - anchor - 1, rank, u.data());
+    place();
+}
+
+void VarsTuple::unrank(int dim, int var_count, std::size_t rank, int *v) {
+    int x = 0;
+    for (int d = 0; d < dim; d++, x++) {
+        for (;; x++) {
+            std::size_t with_x = count(dim - d - 1, var_count - x - 1);
+            if (rank < with_x)
+                break;
+            rank -= with_x;
+        }
+        v[d] = x;
+    }
+}
+
+// The u-th variable other than a[0..j] is u plus the number of them below it,
+// i.e. of q <= j with gaps[q] <= u
+void VarsTuple::place() {
+    const int a = (*anchors)[anchor];
+    const auto gaps_end = gaps->begin() + anchor + 1;
+    bool placed = false;
+    int d = 1;
+    for (int i = 0; i < dim - 1; i++) {
+        int x = u[i] + (std::upper_bound(gaps->begin(), gaps_end, u[i]) - gaps->begin());
+        if (!placed && a < x) {
+            v[d++] = a;
+            placed = true;
+        }
+        v[d++] = x;
+    }
+    if (!placed)
+        v[d] = a;
+}
+
+// Sets the variables after position from to the smallest ones allowed
+bool VarsTuple::fill(int from) {
+    for (int d = from + 1; d <= dim; d++) {
+        v[d] = std::max(lo[d-1], v[d-1] + 1);
+        if (v[d] >= hi[d-1])
+            return false;
+    }
+    return true;
+}
+
+std::size_t VarsTuple::count(int dim, int var_count) {
+    if (dim < 0 || var_count < dim)
+        return 0;
+    std::size_t c = 1;
+    for (int d = 1; d <= dim; d++) {
+        c = c * (var_count - dim + d) / d;
+    }
+    return c;
+}
+
+std::size_t VarsTuple::anchoredCount(int dim, int var_count, int anchor) {
+    return count(dim - 1, var_count - anchor - 1);
+}
+
 void VarsTuple::next() {
+    if (anchors != nullptr) {
+        const int k = dim - 1;
+        const int n = var_count - anchor - 1;
+        int d;
+        for (d = k - 1; d >= 0; d--) {
+            u[d]++;
+            if (u[d] < n - (k - 1 - d))
+                break;
+        }
+        if (d >= 0) {
+            for (d++; d < k; d++)
+                u[d] = u[d-1] + 1;
+        } else {
+            anchor++;
+            if (anchor == (int)anchors->size() || anchoredCount(dim, var_count, anchor) == 0) {
+                v[0] = 1;
+                return;
+            }
+            for (d = 0; d < k; d++)
+                u[d] = d;
+        }
+        place();
+        return;
+    }
+
+    if (!lo.empty()) {
+        for (int d = dim; d >= 1; d--) {
+            v[d]++;
+            if (v[d] < hi[d-1] && fill(d))
+                return;
+        }
+        v[0] = 1;
+        return;
+    }
+
     int d;
     for (d = dim; d >= 0; d--) {
         v[d] ++;
@@ -25,7 +161,7 @@ bool VarsTuple::done() {
     return (v[0] > 0);
 }
 
-int VarsTuple::get(int i) {
+int VarsTuple::get(int i) const {
     return v[i + 1];
 }
 
@@ -38,29 +174,138 @@ std::vector<int>::const_iterator VarsTuple::end() const {
 }
 
 
-MDFSTuple::MDFSTuple(int i, float ig, std::vector<int>&& v): i(i), ig(ig), v(v) {
+MDFSTuples::MDFSTuples(std::size_t limit) : limit(limit), dim(0) {
+}
+
+// The order of the serial walk: by tuple, then by variable
+bool MDFSTuples::before(std::size_t a, std::size_t b) const {
+    const int *va = getVars(a), *vb = getVars(b);
+    for (int j = 0; j < dim; j++) {
+        if (va[j] != vb[j])
+            return va[j] < vb[j];
+    }
+    return var[a] < var[b];
+}
+
+// Ties of IG go by the serial order, so that the tuples kept do not depend
+// on how threads were scheduled
+bool MDFSTuples::better(std::size_t a, std::size_t b) const {
+    if (ig[a] != ig[b])
+        return ig[a] > ig[b];
+    return before(a, b);
 }
 
-void MDFSTuple::Print() {
-    Rprintf("%d:%f:%d", i, ig, v[0]);
-    for (auto u = v.begin() + 1; u != v.end(); u++) {
-        Rprintf(",%d", *u);
+bool MDFSTuples::better(int i, float ig, const int *v, std::size_t b) const {
+    if (ig != this->ig[b])
+        return ig > this->ig[b];
+    const int *vb = getVars(b);
+    for (int j = 0; j < dim; j++) {
+        if (v[j] != vb[j])
+            return v[j] < vb[j];
     }
-    Rprintf("\n");
+    return i < var[b];
 }
 
+void MDFSTuples::set(std::size_t slot, int i, float ig, const int *v) {
+    var[slot] = i;
+    this->ig[slot] = ig;
+    std::copy(v, v + dim, vars.begin() + slot * dim);
+}
 
-MDFSOutput::MDFSOutput(MDFSOutputType type, int var_count): type(type) {
+std::size_t MDFSTuples::size() const {
+    return var.size();
+}
+
+int MDFSTuples::tupleDim() const {
+    return dim;
+}
+
+void MDFSTuples::Add(int i, float ig, const int *v, int dim) {
+    this->dim = dim;
+    if (limit == 0 || var.size() < limit) {
+        var.push_back(i);
+        this->ig.push_back(ig);
+        vars.insert(vars.end(), v, v + dim);
+        if (limit > 0) {
+            heap.push_back(var.size() - 1);
+            std::push_heap(heap.begin(), heap.end(), [this](std::size_t a, std::size_t b) { return better(a, b); });
+        }
+        return;
+    }
+
+    if (!better(i, ig, v, heap.front()))
+        return;
+    auto cmp = [this](std::size_t a, std::size_t b) { return better(a, b); };
+    std::pop_heap(heap.begin(), heap.end(), cmp);
+    set(heap.back(), i, ig, v);
+    std::push_heap(heap.begin(), heap.end(), cmp);
+}
+
+void MDFSTuples::Append(const MDFSTuples &other) {
+    if (limit == 0 && other.size() > 0) {
+        dim = other.dim;
+        var.insert(var.end(), other.var.begin(), other.var.end());
+        ig.insert(ig.end(), other.ig.begin(), other.ig.end());
+        vars.insert(vars.end(), other.vars.begin(), other.vars.end());
+        return;
+    }
+    for (std::size_t t = 0; t < other.size(); t++)
+        Add(other.var[t], other.ig[t], other.getVars(t), other.dim);
+}
+
+// Tuples of threads come in any order: all of them are put in the serial
+// order, the limited ones by decreasing IG
+std::vector<std::size_t> MDFSTuples::Order() const {
+    std::vector<std::size_t> order(size());
+    std::iota(order.begin(), order.end(), 0);
+    if (limit > 0)
+        std::sort(order.begin(), order.end(), [this](std::size_t a, std::size_t b) { return better(a, b); });
+    else
+        std::sort(order.begin(), order.end(), [this](std::size_t a, std::size_t b) { return before(a, b); });
+    return order;
+}
+
+int MDFSTuples::getVar(std::size_t t) const {
+    return var[t];
+}
+
+float MDFSTuples::getIG(std::size_t t) const {
+    return ig[t];
+}
+
+const int *MDFSTuples::getVars(std::size_t t) const {
+    return vars.data() + t * dim;
+}
+
+
+MDFSOutput::MDFSOutput(MDFSOutputType type, int var_count, std::size_t tuple_limit): var_count(var_count), pruned(0), type(type), tuple_limit(tuple_limit) {
     switch(type) {
         case MDFSOutputType::MaxIGs:
             max_igs = new std::vector<float>(var_count);
             break;
         case MDFSOutputType::MatchingTuples:
-            tuples = new std::list<MDFSTuple>();
+            tuples = new MDFSTuples(tuple_limit);
+            break;
+        case MDFSOutputType::PairIGs:
+            pair_igs = nullptr;
+            break;
+        case MDFSOutputType::BatchMaxIGs:
+            batch_max_igs = nullptr;
             break;
    }
 }
 
+MDFSOutput::MDFSOutput(int var_count, double *pair_igs): pair_igs(pair_igs), var_count(var_count), pruned(0), type(MDFSOutputType::PairIGs), tuple_limit(0) {}
+
+MDFSOutput::MDFSOutput(int var_count, std::atomic<float> *batch_max_igs): batch_max_igs(batch_max_igs), var_count(var_count), pruned(0), type(MDFSOutputType::BatchMaxIGs), tuple_limit(0) {}
+
+MDFSOutput::MDFSOutput(const MDFSOutput &out, int var_count): MDFSOutput(out.type, var_count, out.tuple_limit) {
+    if (type == MDFSOutputType::PairIGs)
+        pair_igs = out.pair_igs;
+    if (type == MDFSOutputType::BatchMaxIGs)
+        batch_max_igs = out.batch_max_igs;
+}
+
 MDFSOutput::~MDFSOutput() {
     switch(type) {
         case MDFSOutputType::MaxIGs:
@@ -69,34 +314,317 @@ MDFSOutput::~MDFSOutput() {
         case MDFSOutputType::MatchingTuples:
             delete tuples;
             break;
+        case MDFSOutputType::PairIGs:
+        case MDFSOutputType::BatchMaxIGs:
+            break;
    }
 }
 
-void MDFSOutput::Print() {
+void MDFSOutput::UpdateMaxIG(int i, float v) {
+    (*max_igs)[i] = std::max((*max_igs)[i], v);
+}
+
+void MDFSOutput::UpdateBatchMaxIG(int column, int i, float v) {
+    std::atomic<float> &m = batch_max_igs[(std::size_t)column * var_count + i];
+    float old = m.load(std::memory_order_relaxed);
+    while (v > old && !m.compare_exchange_weak(old, v, std::memory_order_relaxed)) {}
+}
+
+void MDFSOutput::CopyMaxIGsAsDouble(double* copy) {
+    std::copy(max_igs->begin(), max_igs->end(), copy);
+}
+
+void MDFSOutput::AddTuple(int i, float ig, const VarsTuple &vt) {
+    tuples->Add(i, ig, &*vt.begin(), vt.end() - vt.begin());
+}
+
+std::size_t MDFSOutput::TupleCount() const {
+    return tuples->size();
+}
+
+// vars is a column-major TupleCount() x DIM matrix
+void MDFSOutput::CopyTuples(int *var, double *ig, int *vars) {
+    const std::size_t count = tuples->size();
+    const std::vector<std::size_t> order = tuples->Order();
+    for (std::size_t r = 0; r < count; r++) {
+        const std::size_t t = order[r];
+        var[r] = tuples->getVar(t);
+        ig[r] = tuples->getIG(t);
+        const int *v = tuples->getVars(t);
+        for (int j = 0; j < tuples->tupleDim(); j++)
+            vars[j * count + r] = v[j];
+    }
+}
+
+void MDFSOutput::SetPairIG(int i, int j, float ig) {
+    pair_igs[i + (std::size_t)j * var_count] = ig;
+}
+
+void MDFSOutput::CountPruned() {
+    pruned++;
+}
+
+std::size_t MDFSOutput::PrunedCount() const {
+    return pruned;
+}
+
+void MDFSOutput::Merge(MDFSOutput &other) {
+    pruned += other.pruned;
     switch(type) {
         case MDFSOutputType::MaxIGs:
-            Rprintf("%f", (*max_igs)[0]);
-            for (auto v = max_igs->begin() + 1; v != max_igs->end(); v++) {
-                Rprintf("\t%f", *v);
+            for (std::size_t i = 0; i < max_igs->size(); i++) {
+                UpdateMaxIG(i, (*other.max_igs)[i]);
             }
-            Rprintf("\n");
             break;
         case MDFSOutputType::MatchingTuples:
-            for (auto v = tuples->begin(); v != tuples->end(); v++) {
-                v->Print();
-            }
+            tuples->Append(*other.tuples);
+            break;
+        case MDFSOutputType::PairIGs:
+        case MDFSOutputType::BatchMaxIGs:
             break;
    }
 }
 
-void MDFSOutput::UpdateMaxIG(int i, float v) {
-    (*max_igs)[i] = std::max((*max_igs)[i], v);
+TupleSchedule::TupleSchedule(int dim, int var_count, int block_vars, const std::vector<int> &interesting_vars) :
+        dim(dim), var_count(var_count), block_vars(dim > 0 && interesting_vars.empty() ? block_vars : 0) {
+    if (!interesting_vars.empty()) {
+        for (int x : interesting_vars) {
+            if (x >= 0 && x < var_count)
+                anchors.push_back(x);
+        }
+        std::sort(anchors.begin(), anchors.end());
+        anchors.erase(std::unique(anchors.begin(), anchors.end()), anchors.end());
+        std::size_t tuple_count = 0;
+        for (std::size_t q = 0; q < anchors.size(); q++) {
+            gaps.push_back(anchors[q] - q);
+            tuple_count += VarsTuple::anchoredCount(dim, var_count, q);
+        }
+        block_count = 0;
+        chunk_size = tupleChunkSize(tuple_count);
+        chunk_count = (tuple_count + chunk_size - 1) / chunk_size;
+    } else if (this->block_vars > 0) {
+        block_count = (var_count + block_vars - 1) / block_vars;
+        chunk_size = std::numeric_limits<std::size_t>::max();
+        chunk_count = VarsTuple::count(dim, block_count + dim - 1);
+    } else {
+        std::size_t tuple_count = VarsTuple::count(dim, var_count);
+        block_count = 0;
+        chunk_size = tupleChunkSize(tuple_count);
+        chunk_count = (tuple_count + chunk_size - 1) / chunk_size;
+    }
 }
 
-void MDFSOutput::CopyMaxIGsAsDouble(double* copy) {
-    std::copy(max_igs->begin(), max_igs->end(), copy);
+long TupleSchedule::chunks() const {
+    return chunk_count;
 }
 
-void MDFSOutput::AddTuple(int i, float ig, const VarsTuple &vt) {
-    tuples->emplace_back(i, ig, std::vector<int>(vt.begin(), vt.end()));
+std::size_t TupleSchedule::chunkSize() const {
+    return chunk_size;
+}
+
+// Nondecreasing tuples of blocks b[i] are ranked as the increasing ones b[i] + i
+VarsTuple TupleSchedule::first(long chunk) const {
+    if (!anchors.empty())
+        return VarsTuple(dim, var_count, anchors, gaps, chunk * chunk_size);
+    if (block_vars <= 0)
+        return VarsTuple(dim, var_count, chunk * chunk_size);
+
+    VarsTuple blocks(dim, block_count + dim - 1, chunk);
+    std::vector<int> lo(dim), hi(dim);
+    for (int i = 0; i < dim; i++) {
+        int b = blocks.get(i) - i;
+        lo[i] = b * block_vars;
+        hi[i] = std::min((b + 1) * block_vars, var_count);
+    }
+    return VarsTuple(dim, var_count, lo, hi);
+}
+
+// Blocks small enough for every thread to hold its own block, besides the
+// DIM - 1 shared with the chunks next to it, within the working set; and
+// at least two per thread, so that there are chunks to balance.
+int streamBlockVariables(int dim, int var_count, std::size_t variable_bytes) {
+    int threads = mdfsThreadCount();
+    std::size_t fit = STREAM_WORKING_SET_BYTES / ((threads + dim - 1) * std::max(variable_bytes, (std::size_t)1));
+    int balanced = (var_count + 2 * threads - 1) / (2 * threads);
+    return std::max(1, (int)std::min(fit, (std::size_t)balanced));
+}
+
+SubtupleIGs::SubtupleIGs(int dim, int var_count, int discretizations) :
+        dim(dim),
+        discretizations(discretizations),
+        binomials((std::size_t)var_count * dim),
+        igs(VarsTuple::count(dim, var_count) * discretizations) {
+    for (int x = 0; x < var_count; x++)
+        for (int j = 0; j < dim; j++)
+            binomials[x * dim + j] = VarsTuple::count(j + 1, x);
+}
+
+// The cache pays off only when sub-tuples are shared, i.e. when all tuples
+// are walked, and only when it fits the memory limit
+bool SubtupleIGs::useful(const AlgInfo &ai, int var_count, int columns) {
+    if (!ai.interesting_vars.empty() && !ai.prune)
+        return false;
+    std::size_t bytes = VarsTuple::count(ai.DIM - 1, var_count) * ai.DISC * columns * sizeof(float);
+    return bytes <= SUBTUPLE_IGS_MAX_BYTES;
+}
+
+std::size_t SubtupleIGs::rank(const VarsTuple &v) const {
+    std::size_t r = 0;
+    for (int j = 0; j < dim; j++)
+        r += binomials[v.get(j) * dim + j];
+    return r;
+}
+
+std::size_t SubtupleIGs::rank(const VarsTuple &v, int skipped) const {
+    std::size_t r = 0;
+    for (int i = 0, j = 0; j < dim; i++) {
+        if (i == skipped)
+            continue;
+        r += binomials[v.get(i) * dim + j];
+        j++;
+    }
+    return r;
+}
+
+float *SubtupleIGs::get(std::size_t rank) {
+    return igs.data() + rank * discretizations;
+}
+
+TupleBounds::TupleBounds(const AlgInfo &ai, DiscretizedFile *in) :
+        entropies((std::size_t)in->info.variableCount * ai.DISC) {
+    const int objects = in->info.objectCount;
+    const double total = objects + (double)ai.pseudo;
+    const double level_pseudo = (double)ai.pseudo / (ai.DIV + 1);
+    margin = total / 1024;
+
+    #pragma omp parallel
+    {
+        std::vector<int> levels(ai.DIV + 1);
+
+        #pragma omp for schedule(dynamic)
+        for (int v = 0; v < in->info.variableCount; v++) {
+            for (int d = 0; d < ai.DISC; d++) {
+                std::fill(levels.begin(), levels.end(), 0);
+                for (int o = 0; o < objects; o++)
+                    levels[in->get(v, d, o)]++;
+                double h = 0.0;
+                for (int n : levels) {
+                    double m = n + level_pseudo;
+                    h -= m * std::log2(m / total);
+                }
+                entropies[(std::size_t)v * ai.DISC + d] = h;
+            }
+        }
+    }
+}
+
+bool TupleBounds::useful(const AlgInfo &ai, const MDFSOutput &out) {
+    return ai.prune && out.type == MDFSOutputType::MatchingTuples;
+}
+
+// Tells whether none of the variables the tuple would be reported for can
+// pass ig_thr; bound and dbound hold DIM * DISC and DIM floats
+bool TupleBounds::prune(const AlgInfo &ai,
+                        const VarsTuple &v,
+                        const std::vector<int> &current_interesting_vars,
+                        SubtupleIGs *memo,
+                        float *bound,
+                        float *dbound) const {
+    for (int vv = 0; vv < ai.DIM; vv++) {
+        const float *h = entropies.data() + (std::size_t)v.get(vv) * ai.DISC;
+        const float *igg = memo ? memo->get(memo->rank(v, vv)) : nullptr;
+        for (int d = 0; d < ai.DISC; d++)
+            bound[vv * ai.DISC + d] = igg ? std::min(h[d], -igg[d]) : h[d];
+    }
+    reduceDiscretizations(ai, bound, dbound);
+
+    for (int vv = 0; vv < ai.DIM; vv++) {
+        if (dbound[vv] + margin > ai.ig_thr && (current_interesting_vars.empty() || CONTAINS(current_interesting_vars, v.get(vv))))
+            return false;
+    }
+    return true;
+}
+
+std::vector<float> classPseudocounts(const std::vector<int> &class_counts, float pseudo, double cells) {
+    const int objects = std::accumulate(class_counts.begin(), class_counts.end(), 0);
+    std::vector<float> p(class_counts.size());
+    for (std::size_t k = 0; k < p.size(); k++) {
+        p[k]  = (float)class_counts[k] / objects;
+        p[k] *= pseudo;
+        p[k] /= cells;
+    }
+    return p;
+}
+
+static std::vector<float> marginalPseudocounts(std::vector<float> p, int div) {
+    for (float &pk : p)
+        pk *= div + 1;
+    return p;
+}
+
+DecisionTables::DecisionTables(const std::vector<int> &class_counts, float pseudo, int div, int dim) :
+    full(std::accumulate(class_counts.begin(), class_counts.end(), 0),
+         classPseudocounts(class_counts, pseudo, std::pow((double)(div + 1), dim))),
+    marginal(std::accumulate(class_counts.begin(), class_counts.end(), 0),
+             marginalPseudocounts(classPseudocounts(class_counts, pseudo, std::pow((double)(div + 1), dim)), div)) {}
+
+// Fills the interesting variables of the tuple and tells whether it has none
+bool skipTuple(const AlgInfo &ai, const VarsTuple &v, std::vector<int> &current_interesting_vars) {
+    current_interesting_vars.clear();
+    std::set_intersection(
+        v.begin(), v.end(),
+        ai.interesting_vars.begin(), ai.interesting_vars.end(),
+        std::back_inserter(current_interesting_vars));
+    return !ai.interesting_vars.empty() && current_interesting_vars.empty();
+}
+
+// ig is stored per variable: ig[vv * DISC + d]
+void reduceDiscretizations(const AlgInfo &ai, const float *ig, float *dig) {
+    switch (ai.rm) {
+        case reduceMethod::RM_AVG:
+            for (int vv = 0; vv < ai.DIM; vv++) {
+                dig[vv]  = std::accumulate(ig + vv * ai.DISC, ig + vv * ai.DISC + ai.DISC, 0.0f) / ai.DISC;
+            }
+            break;
+        case reduceMethod::RM_MAX:
+            for (int vv = 0; vv < ai.DIM; vv++)
+                dig[vv] = *std::max_element(ig + vv * ai.DISC, ig + vv * ai.DISC + ai.DISC);
+            break;
+        default:
+            break;
+    }
+}
+
+void reportTuple(const AlgInfo &ai,
+                 const VarsTuple &v,
+                 const std::vector<int> &current_interesting_vars,
+                 const float *dig,
+                 MDFSOutput &out,
+                 int column) {
+    switch (out.type) {
+        case MDFSOutputType::MaxIGs:
+            for (int vv = 0; vv < ai.DIM; vv++) {
+                out.UpdateMaxIG(v.get(vv), dig[vv]);
+            }
+            break;
+        case MDFSOutputType::MatchingTuples:
+            for (int vv = 0; vv < ai.DIM; vv++) {
+                if (dig[vv] > ai.ig_thr && (current_interesting_vars.empty() || CONTAINS(current_interesting_vars, v.get(vv)))) {
+                    out.AddTuple(v.get(vv), dig[vv], v);
+                }
+            }
+            break;
+        case MDFSOutputType::PairIGs:
+            for (int vv = 0; vv < 2; vv++) {
+                if (current_interesting_vars.empty() || CONTAINS(current_interesting_vars, v.get(vv))) {
+                    out.SetPairIG(v.get(vv), v.get(1 - vv), dig[vv]);
+                }
+            }
+            break;
+        case MDFSOutputType::BatchMaxIGs:
+            for (int vv = 0; vv < ai.DIM; vv++) {
+                out.UpdateBatchMaxIG(column, v.get(vv), dig[vv]);
+            }
+            break;
+    }
 }
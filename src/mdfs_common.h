@@ -1,16 +1,24 @@
 #ifndef MDFS_COMMON_H
 #define MDFS_COMMON_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
 #include <vector>
-#include <list>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "discretizedfile.h"
+#include "stats.h"
 
-enum class MDFSAccelerationType { Scalar, AVX, AVX2 };
+enum class MDFSAccelerationType { Scalar, AVX, AVX2, Auto };
 
 enum class reduceMethod { RM_MAX, RM_AVG };
 
-enum class MDFSOutputType { MaxIGs, MatchingTuples };
+enum class MDFSOutputType { MaxIGs, MatchingTuples, PairIGs, BatchMaxIGs };
 
 struct AlgInfo {
     int DIM;
@@ -20,46 +28,301 @@ struct AlgInfo {
     reduceMethod rm;
     float ig_thr;
     std::vector<int> interesting_vars;
+    int tile_tuples;
+    int block_vars;
+    bool prune;
+    int classes;
+};
+
+// The shape of the contingency tables of tuples: DIM and DIV, and their
+// (DIV+1)^DIM cells, counted for every decision class. Kernels instantiated
+// for a FixedShape (of two classes) have them as constants, so the loops over
+// variables unroll, the strides fold and the counters are arrays on the
+// stack; RuntimeShape takes any from AlgInfo.
+// Kernels are instantiated for the shapes in MDFS_FIXED_SHAPES, as X(DIM, DIV),
+// and the launcher picks them from its table (DIV = 1 goes to the bitset kernel).
+
+#define MDFS_FIXED_SHAPES(X) X(2, 2) X(2, 3) X(3, 2) X(3, 3)
+
+template <typename T, int N>
+class StackCounters {
+    T c[N];
+public:
+    explicit StackCounters(int) {}
+    T *data() { return c; }
+};
+
+template <typename T>
+class HeapCounters {
+    std::vector<T> c;
+public:
+    explicit HeapCounters(int n) : c(n) {}
+    T *data() { return c.data(); }
+};
+
+template <int D, int V>
+struct FixedShape {
+    explicit FixedShape(const AlgInfo &) {}
+    static constexpr int dim() { return D; }
+    static constexpr int div() { return V; }
+    static constexpr int cells() { return cellCount(V, D); }
+    static constexpr int classes() { return 2; }
+    // counters of both decision classes, of the tuple and of its marginals
+    template <typename T> using Counters = StackCounters<T, 2 * cellCount(V, D)>;
+    template <typename T> using MarginalCounters = StackCounters<T, 2 * cellCount(V, D - 1)>;
+};
+
+class RuntimeShape {
+    const int d;
+    const int v;
+    const int k;
+public:
+    explicit RuntimeShape(const AlgInfo &ai) : d(ai.DIM), v(ai.DIV), k(ai.classes) {}
+    int dim() const { return d; }
+    int div() const { return v; }
+    int cells() const { return cellCount(v, d); }
+    int classes() const { return k; }
+    template <typename T> using Counters = HeapCounters<T>;
+    template <typename T> using MarginalCounters = HeapCounters<T>;
 };
 
+// Objects per tile of the tiled (tile_tuples > 1) vector kernels
+const int TILE_OBJECTS = 512;
+
+// Tuples of increasing variables, walked in lexicographic order. A tuple
+// may be bounded, with its i-th variable in [lo[i], hi[i]) for nondecreasing
+// bounds; it then starts at the first tuple within them.
+// A tuple may instead be anchored, to walk only the tuples containing some of
+// the sorted anchors. Each is walked once, with the first anchor a[j] it
+// contains, as a[j] and DIM-1 increasing indices u into the variables
+// other than a[0..j]; gaps[q] = a[q] - q maps them to variables.
+
 class VarsTuple {
     private:
         const int dim;
         const int var_count;
         std::vector<int> v;
+        std::vector<int> lo;
+        std::vector<int> hi;
+        const std::vector<int> *anchors;
+        const std::vector<int> *gaps;
+        int anchor;
+        std::vector<int> u;
+        bool fill(int from);
+        void place();
+        static void unrank(int dim, int var_count, std::size_t rank, int *v);
     public:
         VarsTuple(int dim, int var_count);
+        VarsTuple(int dim, int var_count, std::size_t rank);
+        VarsTuple(int dim, int var_count, std::vector<int> lo, std::vector<int> hi);
+        VarsTuple(int dim, int var_count, const std::vector<int> &anchors, const std::vector<int> &gaps, std::size_t rank);
+        static std::size_t count(int dim, int var_count);
+        static std::size_t anchoredCount(int dim, int var_count, int anchor);
         void next();
         bool done();
-        int get(int i);
+        int get(int i) const;
         std::vector<int>::const_iterator begin() const;
         std::vector<int>::const_iterator end() const;
 };
 
-class MDFSTuple {
-    int i;
-    float ig;
-    std::vector<int> v;
+// Matching tuples, stored by columns: the variable, its IG and the DIM
+// variables of its tuple, so that millions of them take a few flat arrays.
+// With a limit only that many of the highest IGs are kept, in a heap with
+// the worst one on top, so memory does not grow with a low threshold.
+
+class MDFSTuples {
+    const std::size_t limit;
+    int dim;
+    std::vector<int> var;
+    std::vector<float> ig;
+    std::vector<int> vars;
+    std::vector<std::size_t> heap;
+    bool before(std::size_t a, std::size_t b) const;
+    bool better(std::size_t a, std::size_t b) const;
+    bool better(int i, float ig, const int *v, std::size_t b) const;
+    void set(std::size_t slot, int i, float ig, const int *v);
 public:
-    MDFSTuple(int i, float ig, std::vector<int>&& v);
-    void Print();
+    explicit MDFSTuples(std::size_t limit);
+    std::size_t size() const;
+    int tupleDim() const;
+    void Add(int i, float ig, const int *v, int dim);
+    void Append(const MDFSTuples &other);
+    std::vector<std::size_t> Order() const;
+    int getVar(std::size_t t) const;
+    float getIG(std::size_t t) const;
+    const int *getVars(std::size_t t) const;
 };
 
+// Pair IGs of 2D tuples go to a var_count x var_count matrix owned by the
+// caller (by columns, as in R): the IG of i in the pair of i and j is at
+// [i + j * var_count]; with interesting variables only their rows are set.
+// Every pair is walked once, so the outputs of the threads write their
+// cells straight into it, without locks.
+// Max IGs of the columns of a batch go to var_count of them per column,
+// owned by the caller and zeroed (by columns, as in R); the outputs of the
+// threads share them too, updated atomically, so that there is one copy of
+// them however many columns there are.
+// The tuples skipped by TupleBounds are counted, whatever the output.
+
 class MDFSOutput {
     union {
         std::vector<float>* max_igs;
-        std::list<MDFSTuple>* tuples;
+        MDFSTuples* tuples;
+        double* pair_igs;
+        std::atomic<float>* batch_max_igs;
     };
+    const int var_count;
+    std::size_t pruned;
 public:
     const MDFSOutputType type;
-    MDFSOutput(MDFSOutputType type, int var_count);
+    const std::size_t tuple_limit;
+    MDFSOutput(MDFSOutputType type, int var_count, std::size_t tuple_limit = 0);
+    MDFSOutput(int var_count, double *pair_igs);
+    MDFSOutput(int var_count, std::atomic<float> *batch_max_igs);
+    MDFSOutput(const MDFSOutput &out, int var_count);   // of a thread, merged into out
+    MDFSOutput(const MDFSOutput &) = delete;             // owns what the union points to
+    MDFSOutput &operator=(const MDFSOutput &) = delete;
     ~MDFSOutput();
-    void Print();
     void UpdateMaxIG(int i, float v);
+    void UpdateBatchMaxIG(int column, int i, float v);
     void CopyMaxIGsAsDouble(double* copy);
     void AddTuple(int i, float ig, const VarsTuple &vt);
+    std::size_t TupleCount() const;
+    void CopyTuples(int *var, double *ig, int *vars);
+    void SetPairIG(int i, int j, float ig);
+    void CountPruned();
+    std::size_t PrunedCount() const;
+    void Merge(MDFSOutput &other);
 };
 
-using MDFSFunction = void (*) (AlgInfo, DiscretizedFile*, MDFSOutput&);
+// Tuples are handed out to threads in chunks of consecutive ranks;
+// there are a few chunks per thread so that dynamic scheduling can balance
+// the uneven cost of tuples (e.g. skipped ones).
+// With block_vars > 0 the variables are split into blocks of that many and
+// a chunk walks the tuples whose i-th variable is in the i-th block of a
+// nondecreasing tuple of blocks, so it reads the columns of at most DIM
+// blocks. That keeps the working set of a mapped file small.
+// With interesting variables only the tuples containing some of them are
+// walked, anchored at them, so the cost follows the number of these tuples;
+// the columns of interesting variables are then read by every chunk anyway,
+// so there are no blocks.
+
+const int CHUNKS_PER_THREAD = 64;
+
+inline int mdfsThreadCount() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+inline std::size_t tupleChunkSize(std::size_t tuple_count) {
+    std::size_t chunks = (std::size_t)mdfsThreadCount() * CHUNKS_PER_THREAD;
+    return std::max((std::size_t)1, (tuple_count + chunks - 1) / chunks);
+}
+
+class TupleSchedule {
+    private:
+        const int dim;
+        const int var_count;
+        const int block_vars;
+        int block_count;
+        std::size_t chunk_size;
+        long chunk_count;
+        std::vector<int> anchors;
+        std::vector<int> gaps;
+    public:
+        TupleSchedule(int dim, int var_count, int block_vars,
+                      const std::vector<int> &interesting_vars = std::vector<int>());
+        long chunks() const;
+        std::size_t chunkSize() const;
+        VarsTuple first(long chunk) const;
+};
+
+// Bytes of discretized columns the threads of the streaming mode are meant
+// to keep paged in together
+
+const std::size_t STREAM_WORKING_SET_BYTES = std::size_t(1) << 30;
+
+int streamBlockVariables(int dim, int var_count, std::size_t variable_bytes);
+
+// Information gains of the (DIM-1)-dimensional marginals of tuples, cached for
+// every sub-tuple of DIM-1 variables and every discretization. Each sub-tuple
+// is shared by var_count - DIM + 1 tuples, so its entropy is computed once
+// instead of by marginalizing the counters of every tuple.
+// Sub-tuples are indexed by their colexicographic rank: sum of C(v[j], j + 1).
+// With interesting variables only the tuples of them are walked, which may
+// share few sub-tuples; the memo is then filled only for pruning, whose
+// bound is loose without it (see TupleBounds).
+
+const std::size_t SUBTUPLE_IGS_MAX_BYTES = std::size_t(1) << 30;
+
+class SubtupleIGs {
+    const int dim;
+    const int discretizations;
+    std::vector<std::size_t> binomials;
+    std::vector<float> igs;
+public:
+    SubtupleIGs(int dim, int var_count, int discretizations);
+    static bool useful(const AlgInfo &ai, int var_count, int columns = 1);
+    std::size_t rank(const VarsTuple &v) const;
+    std::size_t rank(const VarsTuple &v, int skipped) const;
+    float *get(std::size_t rank);
+};
+
+// Upper bounds of the IGs of the variables of a tuple, to skip counting the
+// tuples of the matching tuples mode that cannot pass ig_thr.
+// The IG of a variable in a tuple is W I(Y; X_v | X_rest) for the joint
+// distribution with the pseudocounts added (the marginal tables are its
+// marginals) and W = objects + pseudocount, so it is at most both
+//   W H(Y | X_rest) = -(the IG of the (DIM-1)-tuple X_rest), from the memo,
+//   W H(X_v), tabulated for every variable and discretization.
+// Without the memo (it does not fit) only the second one bounds the IGs.
+// The margin covers the rounding of the IGs counted in float.
+
+class TupleBounds {
+    std::vector<float> entropies;
+    float margin;
+public:
+    TupleBounds(const AlgInfo &ai, DiscretizedFile *in);
+    static bool useful(const AlgInfo &ai, const MDFSOutput &out);
+    bool prune(const AlgInfo &ai,
+               const VarsTuple &v,
+               const std::vector<int> &current_interesting_vars,
+               SubtupleIGs *memo,
+               float *bound,
+               float *dbound) const;
+};
+
+// Pseudocounts of a cell of every decision class: pseudo spread over the
+// cells in proportion to the class counts
+
+std::vector<float> classPseudocounts(const std::vector<int> &class_counts, float pseudo, double cells);
+
+// Entropy tables of the DIM-dimensional tables of a decision and of their
+// (DIM-1)-dimensional marginals, whose cells sum DIV+1 of its cells and so
+// their pseudocounts. The objects are the sum of the class counts.
+
+class DecisionTables {
+public:
+    DecisionTables(const std::vector<int> &class_counts, float pseudo, int div, int dim);
+    EntropyTable full;
+    EntropyTable marginal;
+};
+
+bool skipTuple(const AlgInfo &ai, const VarsTuple &v, std::vector<int> &current_interesting_vars);
+
+void reduceDiscretizations(const AlgInfo &ai, const float *ig, float *dig);
+
+// column is that of a batch, for BatchMaxIGs
+void reportTuple(const AlgInfo &ai,
+                 const VarsTuple &v,
+                 const std::vector<int> &current_interesting_vars,
+                 const float *dig,
+                 MDFSOutput &out,
+                 int column = 0);
+
+using MDFSFunction = void (*) (const AlgInfo &, DiscretizedFile*, MDFSOutput&);
 
 #endif
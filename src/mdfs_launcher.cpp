@@ -1,9 +1,191 @@
+#include <R.h>
+#include <Rinternals.h>
+
+#include <climits>
+
+#include "cpu_features.h"
 #include "discretize.h"
+#include "discretization_cache.h"
 #include "mdfs_common.h"
 #include "mdfs_scalar.h"
+#include "mdfs_bitset.h"
+#include "mdfs_sparse.h"
+#include "mdfs_batch.h"
 #include "avxmdfs.h"
 #include "avx2mdfs.h"
 
+// 'auto' picks the widest instruction set of this machine, asking for one
+// it does not have is an error rather than an illegal instruction
+static MDFSAccelerationType supportedAcceleration(MDFSAccelerationType requested)
+{
+    switch (requested) {
+        case MDFSAccelerationType::Auto:
+            if (cpuSupportsAVX2())
+                return MDFSAccelerationType::AVX2;
+            if (cpuSupportsAVX())
+                return MDFSAccelerationType::AVX;
+            return MDFSAccelerationType::Scalar;
+        case MDFSAccelerationType::AVX:
+            if (!cpuSupportsAVX())
+                error("AVX is not supported by this CPU");
+            break;
+        case MDFSAccelerationType::AVX2:
+            if (!cpuSupportsAVX2())
+                error("AVX2 is not supported by this CPU");
+            break;
+        default:
+            break;
+    }
+    return requested;
+}
+
+// The kernel is chosen first, so that the data is discretized straight
+// into the layout it reads: lanes of interleaved discretizations for the
+// discretization-lane vector kernels, plain columns for the others.
+struct MDFSKernel {
+    MDFSFunction mdfs;
+    int lanes;
+};
+
+static MDFSKernel selectKernel(MDFSAccelerationType acceleration, int DISC, int DIV)
+{
+    MDFSKernel kernel = { nullptr, 1 };
+    switch (acceleration) {
+        case MDFSAccelerationType::Scalar:
+            kernel.mdfs = ScalarMDFS;
+            break;
+        // discretizations fill the lanes when they come in whole vectors,
+        // otherwise the lanes go across objects
+        case MDFSAccelerationType::AVX:
+            if (DISC % 4 == 0) {
+                kernel.mdfs = AVXMdfs;
+                kernel.lanes = 4;
+            } else {
+                kernel.mdfs = AVXObjectLaneMdfs;
+            }
+            break;
+        case MDFSAccelerationType::AVX2:
+            if (DISC % 8 == 0) {
+                kernel.mdfs = AVX2Mdfs;
+                kernel.lanes = 8;
+            } else {
+                kernel.mdfs = AVX2ObjectLaneMdfs;
+            }
+            break;
+        default:
+            break;
+    }
+
+    // binary discretizations are counted with popcounts, which beats
+    // any of the histogramming kernels
+    if (DIV == 1) {
+        kernel.mdfs = BitsetMDFS;
+        kernel.lanes = 1;
+    }
+    return kernel;
+}
+
+// The data discretized in an earlier call comes from the cache.
+// Streaming puts it in a mapped file (stream_path) and walks tuples in
+// variable blocks, so that it is paged in block by block; so do cached files.
+static std::shared_ptr<DiscretizedFile> discretizeData(const DataFile &df,
+                                                       DiscretizationInfo di,
+                                                       DiscretizedFileInfo dfi,
+                                                       const char *stream_path,
+                                                       int cache_entries,
+                                                       const char *cache_dir)
+{
+    DiscretizationCache &cache = DiscretizationCache::instance();
+    cache.configure(std::max(cache_entries, 0), cache_dir);
+    return cache.discretize(&df, di, dfi, stream_path);
+}
+
+// Kernels compiled for a fixed dimension and number of divisions, which
+// keep their counters on the stack and unroll the loops over the table
+struct MDFSSpecialization {
+    MDFSFunction generic;
+    int dim;
+    int div;
+    MDFSFunction fixed;
+};
+
+#define SPECIALIZE(DIM, DIV) \
+    { ScalarMDFS, DIM, DIV, ScalarMDFSFixed<DIM, DIV> }, \
+    { AVXMdfs, DIM, DIV, AVXMdfsFixed<DIM, DIV> }, \
+    { AVXObjectLaneMdfs, DIM, DIV, AVXObjectLaneMdfsFixed<DIM, DIV> }, \
+    { AVX2Mdfs, DIM, DIV, AVX2MdfsFixed<DIM, DIV> }, \
+    { AVX2ObjectLaneMdfs, DIM, DIV, AVX2ObjectLaneMdfsFixed<DIM, DIV> },
+static const MDFSSpecialization specializations[] = {
+    MDFS_FIXED_SHAPES(SPECIALIZE)
+};
+#undef SPECIALIZE
+
+static MDFSFunction specializedKernel(MDFSFunction mdfs, int DIM, int DIV)
+{
+    for (const MDFSSpecialization &s : specializations)
+        if (s.generic == mdfs && s.dim == DIM && s.div == DIV)
+            return s.fixed;
+    return mdfs;
+}
+
+// Tables that are mostly empty buckets are counted sparsely, whichever
+// kernel the data was laid out for. The sparse, bitset and fixed shape
+// kernels count two decision classes; more are counted by the generic ones.
+static void runKernel(MDFSFunction mdfs, AlgInfo ai, DiscretizedFile *in, MDFSOutput &out)
+{
+    ai.classes = in->classes();
+    if (ai.classes > 2) {
+        if (mdfs == BitsetMDFS)
+            mdfs = ScalarMDFS;
+    } else if (sparseContingency(ai, in->info.objectCount)) {
+        mdfs = SparseMDFS;
+    } else {
+        mdfs = specializedKernel(mdfs, ai.DIM, ai.DIV);
+    }
+    ai.block_vars = in->mapped() ? streamBlockVariables(ai.DIM, in->info.variableCount, in->info.variableBytes()) : 0;
+    if (mdfs != nullptr)
+        mdfs(ai, in, out);
+}
+
+// The dense kernels count planes of (DIV+1)^DIM cells indexed by int; the
+// tables of two decision classes (or of batches) beyond that are counted
+// sparsely, those of more classes are rejected
+static void checkTableSize(int dimension, int divisions, int planes)
+{
+    if (!cellCountFits(divisions, dimension, planes))
+        error("Contingency tables of %d divisions in %d dimensions are too large for %d decision classes",
+              divisions, dimension, planes);
+}
+
+static AlgInfo algInfo(DiscretizedFileInfo info,
+                       int dimension,
+                       double pseudocount,
+                       int reduce,
+                       double ig_thr,
+                       const int *interesting_vars,
+                       int interesting_vars_count,
+                       int tile_tuples,
+                       bool prune)
+{
+    AlgInfo ai;
+    ai.pseudo = (float) pseudocount;
+    ai.DIM = dimension;
+    ai.DIV = info.divisions;
+    ai.DISC = info.discretizations;
+    ai.rm = reduceMethod(reduce);
+    ai.ig_thr = ig_thr;
+    // sorted, as the tuples are intersected with them
+    ai.interesting_vars = std::vector<int>(interesting_vars, interesting_vars + interesting_vars_count);
+    std::sort(ai.interesting_vars.begin(), ai.interesting_vars.end());
+    ai.interesting_vars.erase(std::unique(ai.interesting_vars.begin(), ai.interesting_vars.end()),
+                              ai.interesting_vars.end());
+    ai.tile_tuples = tile_tuples;
+    ai.block_vars = 0;
+    ai.prune = prune;
+    ai.classes = 2;
+    return ai;
+}
+
 extern "C"
 void CuCubes(MDFSAccelerationType *acceleration_type,
              MDFSOutputType *out_type,
@@ -18,66 +200,294 @@ void CuCubes(MDFSAccelerationType *acceleration_type,
                   double *pseudocount,   // suma wszystkich pseudozliczeń we wszystkich
                                          // kubełkach (vokselach)
                   int *reduce,           // 0 - max, 1 - avg
-                  double *ig_thr,        // ig threshold value for the matching tuples output mode
-                  int *interesting_vars, // interesting vars for the matching tuples output mode
+                  double *ig_thr,        // unused, as there is no matching tuples output here
+                  int *interesting_vars, // interesting vars, the only ones whose tuples are counted
                   int *interesting_vars_count,
+                  int *tile_tuples,      // tuples counted together by the tiled vector kernels
+                  char **disc_file,      // file to discretize into and stream from ("" for memory)
+                  int *cache_entries,    // discretized files kept in memory between calls
+                  char **cache_dir,      // directory of discretized files kept between sessions ("" for none)
                   double *data,          // długość n*k double, macierz - w formacie R, podajemy najpierw
                                          // wartości kolumny (czyli jednej zmiennej dla wszystkich obiektów)
-                  int *decision,         // zmienna decyzyjna Boolowska - 0/1
+                  int *decision,         // zmienna decyzyjna - klasy 0, 1, ..., K-1
                   double *IGmax)         // max IGs for each variable: array of length k
 {
     int VAR = *k;
     int OBJ = *n;
-    int DIM = *dimension;
     int DIV = *divisions;
     int DISC = *discretizations;
     int SEED = *seed;
 
-    DataFile *df = new DataFile(DataFileInfo(OBJ, VAR), data, decision);
+    // tuples and pair IGs are returned to R by the sessions
+    if (*out_type != MDFSOutputType::MaxIGs)
+        error("CuCubes() computes max IGs only");
 
-    DiscretizedFileInfo dfi(DISC, OBJ, VAR);
-    DiscretizedFile *in = new DiscretizedFile(dfi);
-    in->allocate();
+    int classes = 2;
+    for (int o = 0; o < OBJ; o++)
+        classes = std::max(classes, decision[o] + 1);
+    if (classes > 2)
+        checkTableSize(*dimension, DIV, classes);
 
-    DiscretizationInfo di(SEED, DISC, DIV, (float)*range);
-    discretizeFile(df, in, di);
+    MDFSKernel kernel = selectKernel(supportedAcceleration(*acceleration_type), DISC, DIV);
 
-    AlgInfo ai;
-    ai.pseudo = (float) *pseudocount;
-    ai.DIM = DIM;
-    ai.DIV = DIV;
-    ai.DISC = DISC;
-    ai.rm = reduceMethod(*reduce);
-    ai.ig_thr = *ig_thr;
-    ai.interesting_vars = std::vector<int>(interesting_vars, interesting_vars + *interesting_vars_count);
-
-    MDFSOutput out(*out_type, VAR);
-
-    MDFSFunction mdfs = nullptr;
-    switch (*acceleration_type) {
-        case MDFSAccelerationType::Scalar:
-            mdfs = ScalarMDFS;
-            break;
-        case MDFSAccelerationType::AVX:
-            mdfs = AVXMdfs;
-            break;
-        case MDFSAccelerationType::AVX2:
-            mdfs = AVX2Mdfs;
-            break;
+    // R's buffers are read in place; error() unwinds without running
+    // destructors, so it is only called once everything here is gone
+    bool created = true;
+    {
+        DataFile df(DataFileInfo(OBJ, VAR), data, decision);
+        DiscretizedFileInfo dfi(DISC, OBJ, VAR, DIV, kernel.lanes);
+        DiscretizationInfo di(SEED, DISC, DIV, (float)*range);
+
+        std::shared_ptr<DiscretizedFile> in = discretizeData(df, di, dfi, *disc_file, *cache_entries, *cache_dir);
+        created = in != nullptr;
+
+        if (created) {
+            AlgInfo ai = algInfo(dfi, *dimension, *pseudocount, *reduce, *ig_thr,
+                                 interesting_vars, *interesting_vars_count, *tile_tuples, false);
+            MDFSOutput out(MDFSOutputType::MaxIGs, VAR);
+            runKernel(kernel.mdfs, ai, in.get(), out);
+            out.CopyMaxIGsAsDouble(IGmax);
+        }
     }
 
-    if (mdfs != nullptr) {
-        mdfs(ai, in, out);
-        switch (*out_type) {
+    if (!created)
+        error("Cannot create the discretized file %s", *disc_file);
+}
+
+// Sessions keep the discretized data of one matrix for any number of runs,
+// which then skip copying and discretizing it. R owns them through external
+// pointers. The OpenMP threads persist between calls anyway.
+
+class MDFSSession {
+public:
+    MDFSSession(MDFSKernel kernel, std::shared_ptr<DiscretizedFile> in) : kernel(kernel), in(in) {}
+    const MDFSKernel kernel;
+    const std::shared_ptr<DiscretizedFile> in;
+};
+
+static void finalizeSession(SEXP session)
+{
+    delete static_cast<MDFSSession *>(R_ExternalPtrAddr(session));
+    R_ClearExternalPtr(session);
+}
+
+static MDFSSession *sessionPointer(SEXP session)
+{
+    MDFSSession *s = nullptr;
+    if (TYPEOF(session) == EXTPTRSXP)
+        s = static_cast<MDFSSession *>(R_ExternalPtrAddr(session));
+    if (s == nullptr)
+        error("Not a valid CuCubes session");
+    return s;
+}
+
+extern "C"
+SEXP CuCubesSessionCreate(SEXP acceleration_type,
+                          SEXP n,
+                          SEXP k,
+                          SEXP divisions,
+                          SEXP discretizations,
+                          SEXP seed,
+                          SEXP range,
+                          SEXP disc_file,
+                          SEXP cache_entries,
+                          SEXP cache_dir,
+                          SEXP data,          // n*k doubles, column-major
+                          SEXP decision)      // n integer classes 0, 1, ..., K-1
+{
+    int VAR = asInteger(k);
+    int OBJ = asInteger(n);
+    int DIV = asInteger(divisions);
+    int DISC = asInteger(discretizations);
+    const char *path = CHAR(STRING_ELT(disc_file, 0));
+
+    MDFSKernel kernel = selectKernel(supportedAcceleration((MDFSAccelerationType)asInteger(acceleration_type)), DISC, DIV);
+
+    SEXP session = PROTECT(R_MakeExternalPtr(nullptr, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(session, finalizeSession, TRUE);
+
+    bool created = true;
+    {
+        DataFile df(DataFileInfo(OBJ, VAR), REAL(data), INTEGER(decision));
+        DiscretizedFileInfo dfi(DISC, OBJ, VAR, DIV, kernel.lanes);
+        DiscretizationInfo di(asInteger(seed), DISC, DIV, (float)asReal(range));
+
+        std::shared_ptr<DiscretizedFile> in = discretizeData(df, di, dfi, path, asInteger(cache_entries),
+                                                             CHAR(STRING_ELT(cache_dir, 0)));
+        created = in != nullptr;
+        if (created)
+            R_SetExternalPtrAddr(session, new MDFSSession(kernel, in));
+    }
+
+    if (!created)
+        error("Cannot create the discretized file %s", path);
+
+    UNPROTECT(1);
+    return session;
+}
+
+// Max IGs (output type 0) are returned as a vector; matching tuples as
+// list(var, ig, tuple matrix), at most tuple_limit of the highest IGs if it is set;
+// pair IGs (2D only) as a k x k matrix, written by the kernel in place
+static SEXP matchingTuples(MDFSOutput &out, int dimension)
+{
+    const std::size_t count = out.TupleCount();
+    SEXP result = PROTECT(allocVector(VECSXP, 4));
+    SEXP var = allocVector(INTSXP, count);
+    SET_VECTOR_ELT(result, 0, var);
+    SEXP ig = allocVector(REALSXP, count);
+    SET_VECTOR_ELT(result, 1, ig);
+    SEXP vars = allocMatrix(INTSXP, count, dimension);
+    SET_VECTOR_ELT(result, 2, vars);
+    out.CopyTuples(INTEGER(var), REAL(ig), INTEGER(vars));
+    SET_VECTOR_ELT(result, 3, ScalarReal((double)out.PrunedCount()));
+    UNPROTECT(1);
+    return result;
+}
+
+extern "C"
+SEXP CuCubesSessionRun(SEXP session,
+                       SEXP out_type,
+                       SEXP dimension,
+                       SEXP pseudocount,
+                       SEXP reduce,
+                       SEXP ig_thr,
+                       SEXP interesting_vars,
+                       SEXP tuple_limit,
+                       SEXP tile_tuples,
+                       SEXP prune)
+{
+    MDFSSession *s = sessionPointer(session);
+    MDFSOutputType type = (MDFSOutputType)asInteger(out_type);
+    DiscretizedFileInfo info = s->in->info;
+
+    if (type == MDFSOutputType::PairIGs && asInteger(dimension) != 2)
+        error("Pair IGs are computed in 2 dimensions only");
+    if (s->in->classes() > 2)
+        checkTableSize(asInteger(dimension), info.divisions, s->in->classes());
+
+    SEXP result = R_NilValue;
+    if (type == MDFSOutputType::MaxIGs)
+        result = allocVector(REALSXP, info.variableCount);
+    if (type == MDFSOutputType::PairIGs) {
+        result = allocMatrix(REALSXP, info.variableCount, info.variableCount);
+        std::fill(REAL(result), REAL(result) + (std::size_t)info.variableCount * info.variableCount, 0.0);
+    }
+    PROTECT(result);
+
+    {
+        AlgInfo ai = algInfo(info, asInteger(dimension), asReal(pseudocount), asInteger(reduce), asReal(ig_thr),
+                             INTEGER(interesting_vars), LENGTH(interesting_vars), asInteger(tile_tuples),
+                             asInteger(prune) != 0);
+        std::unique_ptr<MDFSOutput> out(type == MDFSOutputType::PairIGs
+                                        ? new MDFSOutput(info.variableCount, REAL(result))
+                                        : new MDFSOutput(type, info.variableCount, std::max(asInteger(tuple_limit), 0)));
+        runKernel(s->kernel.mdfs, ai, s->in.get(), *out);
+        switch (type) {
             case MDFSOutputType::MaxIGs:
-                out.CopyMaxIGsAsDouble(IGmax);
+                out->CopyMaxIGsAsDouble(REAL(result));
                 break;
             case MDFSOutputType::MatchingTuples:
-                out.Print();
+                result = matchingTuples(*out, ai.DIM);
+                break;
+            case MDFSOutputType::PairIGs:
+            case MDFSOutputType::BatchMaxIGs:
                 break;
         }
     }
 
-    delete in;
-    delete df;
+    UNPROTECT(1);
+    return result;
+}
+
+// Runs a batch kernel on the data of the session, the result is a k x B
+// matrix of max IGs, with a column for every column of the batch.
+// As for single runs, mostly empty tables (or too large ones) are counted
+// sparsely and binary discretizations with popcounts, of decisions only.
+static void runBatch(MDFSSession *s,
+                     SEXP dimension,
+                     SEXP pseudocount,
+                     SEXP reduce,
+                     const ObjectBatch &batch,
+                     SEXP result)
+{
+    DiscretizedFileInfo info = s->in->info;
+    AlgInfo ai = algInfo(info, asInteger(dimension), asReal(pseudocount), asInteger(reduce), 0.0,
+                         nullptr, 0, 1, false);
+    ai.classes = batch.classes;
+    ai.block_vars = s->in->mapped() ? streamBlockVariables(ai.DIM, info.variableCount, info.variableBytes()) : 0;
+    std::vector<std::atomic<float>> max_igs((std::size_t)info.variableCount * batch.size);
+    MDFSOutput out(info.variableCount, max_igs.data());
+    if (sparseContingency(ai, info.objectCount) || !cellCountFits(ai.DIV, ai.DIM, batch.classes))
+        SparseBatchMDFS(ai, s->in.get(), batch, out);
+    else if (ai.DIV == 1 && !batch.weighted())
+        BitsetBatchMDFS(ai, s->in.get(), batch, out);
+    else
+        BatchMDFS(ai, s->in.get(), batch, out);
+    for (std::size_t i = 0; i < max_igs.size(); i++)
+        REAL(result)[i] = max_igs[i].load();
+}
+
+// Max IGs for every column of a matrix of decisions (n x B 0/1 integers) of
+// the data of the session, counted in one walk of the tuples
+extern "C"
+SEXP CuCubesSessionRunBatch(SEXP session,
+                            SEXP dimension,
+                            SEXP pseudocount,
+                            SEXP reduce,
+                            SEXP decisions)
+{
+    MDFSSession *s = sessionPointer(session);
+    DiscretizedFileInfo info = s->in->info;
+
+    if (!isMatrix(decisions) || nrows(decisions) != info.objectCount)
+        error("Decisions must be a matrix with a row for every object");
+
+    SEXP result = PROTECT(allocMatrix(REALSXP, info.variableCount, ncols(decisions)));
+    runBatch(s, dimension, pseudocount, reduce,
+             ObjectBatch::decisions(info.objectCount, ncols(decisions), INTEGER(decisions)), result);
+    UNPROTECT(1);
+    return result;
+}
+
+// Max IGs of the data and decision of the session for every column of a
+// matrix of integer weights of objects (n x B), e.g. bootstrap replicates,
+// counted in one walk of the tuples
+extern "C"
+SEXP CuCubesSessionRunReplicates(SEXP session,
+                                 SEXP dimension,
+                                 SEXP pseudocount,
+                                 SEXP reduce,
+                                 SEXP weights)
+{
+    MDFSSession *s = sessionPointer(session);
+    DiscretizedFileInfo info = s->in->info;
+    const int classes = s->in->classes();
+
+    if (!isMatrix(weights) || nrows(weights) != info.objectCount)
+        error("Weights must be a matrix with a row for every object");
+    const int *w = INTEGER(weights);
+    double table_bytes = 0;
+    for (int j = 0; j < ncols(weights); j++) {
+        double total = 0;
+        for (int o = 0; o < info.objectCount; o++) {
+            const int wo = w[(std::size_t)j * info.objectCount + o];
+            if (wo < 0 || wo > BATCH_MAX_WEIGHT)
+                error("Weights must be integers between 0 and %d", BATCH_MAX_WEIGHT);
+            total += wo;
+        }
+        if (total == 0 || total > INT_MAX)
+            error("Weights of a replicate must sum to between 1 and %d", INT_MAX);
+        table_bytes += batchTableBytes(classes, total);
+    }
+    // an upper bound, as columns of the same class counts share their tables
+    if (table_bytes > BATCH_TABLE_BYTES)
+        error("Entropy tables of the replicates would take %.0f MB, above %.0f MB; use fewer replicates or smaller weights",
+              table_bytes / (1 << 20), BATCH_TABLE_BYTES / (1 << 20));
+
+    SEXP result = PROTECT(allocMatrix(REALSXP, info.variableCount, ncols(weights)));
+    runBatch(s, dimension, pseudocount, reduce,
+             ObjectBatch::replicates(info.objectCount, ncols(weights), w, s->in->decision, classes), result);
+    UNPROTECT(1);
+    return result;
 }
@@ -3,8 +3,14 @@
 
 #include "mdfs_common.h"
 
-void ScalarMDFS(AlgInfo ai,
+void ScalarMDFS(const AlgInfo &ai,
                 DiscretizedFile *in,
                 MDFSOutput &out);
 
+// The same for a fixed shape, instantiated for MDFS_FIXED_SHAPES
+template <int DIM, int DIV>
+void ScalarMDFSFixed(const AlgInfo &ai,
+                     DiscretizedFile *in,
+                     MDFSOutput &out);
+
 #endif
@@ -0,0 +1,253 @@
+#ifndef MDFS_SCHEME
+#define MDFS_SCHEME
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "mdfs_common.h"
+#include "stats.h"
+
+// Tuple walk of every kernel but the tiled vector ones. The Counter counts
+// the contingency table of a tuple in one discretization and gives its
+// information gains; how it counts is up to it (dense, sparse or bitset
+// tables). It may count several columns of the tuple at once, the decisions
+// or replicates of a batch (see mdfs_batch.h); the gains of a column follow
+// selectColumn, called for the columns in order after every count:
+//
+//   int columns()
+//   void computePrefix(const VarsTuple &v, int d)   of the first DIM-1
+//                                                   variables of v, kept
+//                                                   for countTuple in d
+//   void countTuple(const VarsTuple &v, int d)
+//   void selectColumn(int j)
+//   float informationGain()
+//   float marginalInformationGain(int vv)           without the variable vv
+//   void countSubtuple(const VarsTuple &s, int d)   of DIM-1 variables
+//   float subtupleInformationGain()
+//
+// The memo then holds the IGs of a sub-tuple for every column and
+// discretization, igg[j * DISC + d].
+// Every thread counts with its own copy of the Counter it is given.
+// These are included from translation units compiled with different
+// instruction sets, hence internal.
+
+namespace {
+
+template <typename Counter>
+void fillSubtupleIGs(const AlgInfo &ai,
+                     int var_count,
+                     const Counter &prototype,
+                     SubtupleIGs *memo) {
+    const TupleSchedule schedule(ai.DIM - 1, var_count, ai.block_vars);
+    const long chunks = schedule.chunks();
+
+    #pragma omp parallel
+    {
+        Counter counter(prototype);
+        const int columns = counter.columns();
+
+        #pragma omp for schedule(dynamic)
+        for (long chunk = 0; chunk < chunks; ++chunk) {
+            VarsTuple s = schedule.first(chunk);
+            for (std::size_t t = 0; t < schedule.chunkSize() && !s.done(); ++t, s.next()) {
+                float* igg = memo->get(memo->rank(s));
+                for (int d = 0; d < ai.DISC; ++d) {
+                    counter.countSubtuple(s, d);
+                    for (int j = 0; j < columns; j++) {
+                        counter.selectColumn(j);
+                        igg[j * ai.DISC + d] = counter.subtupleInformationGain();
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename Counter>
+void mdfs_scheme(const AlgInfo &ai,
+                 DiscretizedFile *in,
+                 const Counter &prototype,
+                 MDFSOutput &out) {
+    const int DIM = ai.DIM;
+    const int var_count = in->info.variableCount;
+    const int columns = prototype.columns();
+
+    std::unique_ptr<SubtupleIGs> memo;
+    if (SubtupleIGs::useful(ai, var_count, columns)) {
+        memo.reset(new SubtupleIGs(DIM - 1, var_count, ai.DISC * columns));
+        fillSubtupleIGs(ai, var_count, prototype, memo.get());
+    }
+
+    std::unique_ptr<TupleBounds> bounds;
+    if (TupleBounds::useful(ai, out))
+        bounds.reset(new TupleBounds(ai, in));
+
+    const TupleSchedule schedule(DIM, var_count, ai.block_vars, ai.interesting_vars);
+    const long chunks = schedule.chunks();
+
+    #pragma omp parallel
+    {
+        MDFSOutput thread_out(out, var_count);
+
+        Counter counter(prototype);
+
+        std::vector<float> ig((std::size_t)columns * DIM * ai.DISC);
+        std::vector<float> dig(DIM);
+        std::vector<float*> iggs(DIM);
+        std::vector<int> prefix_vars(DIM - 1);
+        bool prefix_valid = false;
+        std::vector<int> current_interesting_vars;
+        std::vector<float> bound(DIM * ai.DISC);
+        std::vector<float> dbound(DIM);
+
+        #pragma omp for schedule(dynamic)
+        for (long chunk = 0; chunk < chunks; ++chunk) {
+            VarsTuple v = schedule.first(chunk);
+            for (std::size_t t = 0; t < schedule.chunkSize() && !v.done(); ++t, v.next()) {
+                if (skipTuple(ai, v, current_interesting_vars)) {
+                    continue;
+                }
+
+                if (bounds && bounds->prune(ai, v, current_interesting_vars, memo.get(), bound.data(), dbound.data())) {
+                    thread_out.CountPruned();
+                    continue;
+                }
+
+                if (memo) {
+                    for (int vv = 0; vv < DIM; vv++) {
+                        iggs[vv] = memo->get(memo->rank(v, vv));
+                    }
+                }
+
+                if (!prefix_valid || !std::equal(prefix_vars.begin(), prefix_vars.end(), v.begin())) {
+                    std::copy(v.begin(), v.end() - 1, prefix_vars.begin());
+                    prefix_valid = true;
+                    for (int d = 0; d < ai.DISC; ++d) {
+                        counter.computePrefix(v, d);
+                    }
+                }
+
+                for (int d = 0; d < ai.DISC; ++d) {
+                    counter.countTuple(v, d);
+
+                    for (int j = 0; j < columns; j++) {
+                        counter.selectColumn(j);
+
+                        float ign = counter.informationGain();
+
+                        float *igj = ig.data() + (std::size_t)j * DIM * ai.DISC;
+                        for (int vv = 0; vv < DIM; vv++) {
+                            float igg = memo ? iggs[vv][j * ai.DISC + d] : counter.marginalInformationGain(vv);
+                            igj[vv * ai.DISC + d] = ign - igg;
+                        }
+                    }
+                }
+
+                for (int j = 0; j < columns; j++) {
+                    reduceDiscretizations(ai, ig.data() + (std::size_t)j * DIM * ai.DISC, dig.data());
+                    reportTuple(ai, v, current_interesting_vars, dig.data(), thread_out, j);
+                }
+            }
+        }
+
+        #pragma omp critical
+        out.Merge(thread_out);
+    }
+}
+
+// Dense tables of the decision of the data, of any number of classes,
+// counted by Counts into planes of cc counters, which a FixedShape keeps on
+// the stack:
+//
+//   Counts(int objects, int cc, int classes)
+//   std::size_t prefixLength()
+//   void countTuple(div, dim, cols, decision, counters)
+//   void computePrefix(div, dim, cols, decision, prefix)
+//   void countWithPrefix(prefix, last, stride, counters)
+
+template <typename Counts, typename Shape>
+class DenseCounter {
+public:
+    DenseCounter(const AlgInfo &ai, DiscretizedFile *in, const DecisionTables &tables) :
+        shape(ai),
+        in(in),
+        tables(&tables),
+        tuple_counts(in->info.objectCount, cc(), shape.classes()),
+        subtuple_counts(in->info.objectCount, cd(), shape.classes()),
+        prefix_length(tuple_counts.prefixLength()),
+        prefixes(ai.DISC * prefix_length),
+        cols(shape.dim()),
+        cell_counters(shape.classes() * cc()),
+        marginal_counters(shape.classes() * cd()) {}
+
+    int columns() const {
+        return 1;
+    }
+
+    void selectColumn(int) {}
+
+    void computePrefix(const VarsTuple &v, int d) {
+        for (int vv = 0; vv < shape.dim() - 1; vv++) {
+            cols[vv] = in->getVD(v.get(vv), d);
+        }
+        tuple_counts.computePrefix(shape.div(), shape.dim(), cols.data(), in->decision.data(),
+                                   prefixes.data() + d * prefix_length);
+    }
+
+    void countTuple(const VarsTuple &v, int d) {
+        tuple_counts.countWithPrefix(prefixes.data() + d * prefix_length,
+                                     in->getVD(v.get(shape.dim() - 1), d), cd(), cell_counters.data());
+    }
+
+    float informationGain() {
+        return tables->full.informationGain(cc(), cell_counters.data());
+    }
+
+    float marginalInformationGain(int vv) {
+        for (int k = 0; k < shape.classes(); k++) {
+            reduceCounter(shape.div(), cell_counters.data() + k * cc(), shape.dim(),
+                          marginal_counters.data() + k * cd(), vv + 1);
+        }
+        return tables->marginal.informationGain(cd(), marginal_counters.data());
+    }
+
+    void countSubtuple(const VarsTuple &s, int d) {
+        for (int vv = 0; vv < shape.dim() - 1; vv++) {
+            cols[vv] = in->getVD(s.get(vv), d);
+        }
+        subtuple_counts.countTuple(shape.div(), shape.dim() - 1, cols.data(), in->decision.data(),
+                                   marginal_counters.data());
+    }
+
+    float subtupleInformationGain() {
+        return tables->marginal.informationGain(cd(), marginal_counters.data());
+    }
+
+private:
+    int cc() const { return shape.cells(); }
+    int cd() const { return shape.cells() / (shape.div() + 1); }
+
+    const Shape shape;
+    DiscretizedFile *in;
+    const DecisionTables *tables;
+    Counts tuple_counts;
+    Counts subtuple_counts;
+    std::size_t prefix_length;
+    std::vector<uint32_t> prefixes;
+    std::vector<const uint8_t*> cols;
+    typename Shape::template Counters<uint32_t> cell_counters;
+    typename Shape::template MarginalCounters<uint32_t> marginal_counters;
+};
+
+template <typename Counts, typename Shape = RuntimeShape>
+void denseMdfs(const AlgInfo &ai,
+               DiscretizedFile *in,
+               MDFSOutput &out) {
+    const DecisionTables tables(in->classCounts(), ai.pseudo, ai.DIV, ai.DIM);
+    mdfs_scheme(ai, in, DenseCounter<Counts, Shape>(ai, in, tables), out);
+}
+
+}
+
+#endif
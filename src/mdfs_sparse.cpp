@@ -0,0 +1,412 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "mdfs_sparse.h"
+#include "mdfs_scheme.h"
+#include "stats.h"
+
+// Keys are bucket indices of objects (in the digits of the other kernels)
+// with the decision as the lowest bit, so that a sorted table is walked by
+// its runs: a run of equal buckets is one occupied cell. Every empty cell
+// adds the same f0[0] + f1[0] - f[0], so they are added at once.
+
+static float sortedInformationGain(const EntropyTable &table, double cells, const uint64_t *keys, std::size_t count) {
+    float ig = 0.0f;
+    double occupied = 0;
+    for (std::size_t i = 0; i < count; occupied++) {
+        const uint64_t b = keys[i] >> 1;
+        uint32_t n[2] = { 0, 0 };
+        for (; i < count && (keys[i] >> 1) == b; i++)
+            n[keys[i] & 1]++;
+        ig += table.fc[0][n[0]] + table.fc[1][n[1]] - table.f[n[0] + n[1]];
+    }
+    ig += (float)((cells - occupied) * (table.fc[0][0] + table.fc[1][0] - table.f[0]));
+    return ig;
+}
+
+static float sparseInformationGain(const EntropyTable &table, double cells, std::vector<uint64_t> &keys) {
+    std::sort(keys.begin(), keys.end());
+    return sortedInformationGain(table, cells, keys.data(), keys.size());
+}
+
+// Marginal keys, without the digit of variable vv (of weight power)
+static void reduceKeys(const std::vector<uint64_t> &keys, uint64_t power, uint64_t base, std::vector<uint64_t> &reduced) {
+    for (std::size_t o = 0; o < keys.size(); o++) {
+        const uint64_t b = keys[o] >> 1;
+        const uint64_t r = b / (power * base) * power + b % power;
+        reduced[o] = (r << 1) | (keys[o] & 1);
+    }
+}
+
+// The last variable of a tuple is its most significant digit, so with the
+// objects sorted by their prefix keys once per prefix, a stable counting sort
+// on that digit sorts the keys of every tuple of the sweep in O(objects).
+
+template <DiscretizedStorage S>
+class SparseKeys {
+public:
+    SparseKeys(DiscretizedFile *in, int div) :
+        in(in), objects(in->info.objectCount), lanes(in->info.lanes), base(div + 1) {}
+
+    // Keys of the first dim variables of v, in discretization d, and the
+    // decision of two classes in the low bit (a batch ignores it, the data
+    // may then have more)
+    void tupleKeys(const VarsTuple &v, int dim, int d, uint64_t *keys) const {
+        for (int o = 0; o < objects; o++)
+            keys[o] = 0;
+        for (int vv = dim - 1; vv >= 0; vv--) {
+            const uint8_t *col = in->getVD(v.get(vv), d);
+            for (int o = 0; o < objects; o++)
+                keys[o] = keys[o] * base + discretizedValue<S>(col, o * lanes + d % lanes);
+        }
+        for (int o = 0; o < objects; o++)
+            keys[o] = (keys[o] << 1) | (in->decision[o] & 1);
+    }
+
+    // Sorts the keys, keeping in order the object of each
+    void sortKeys(uint64_t *keys, int *order) const {
+        std::iota(order, order + objects, 0);
+        std::sort(order, order + objects, [keys](int a, int b) { return keys[a] < keys[b]; });
+        std::vector<uint64_t> sorted(objects);
+        for (int i = 0; i < objects; i++)
+            sorted[i] = keys[order[i]];
+        std::copy(sorted.begin(), sorted.end(), keys);
+    }
+
+    // Sorted keys of the sorted prefix with variable x of weight power added,
+    // and the object of each if sorted_order is given
+    void addVariable(const uint64_t *prefix, const int *order, int x, int d, uint64_t power,
+                     std::vector<int> &digits, std::vector<int> &start, uint64_t *keys,
+                     int *sorted_order = nullptr) const {
+        const uint8_t *col = in->getVD(x, d);
+        std::fill(start.begin(), start.end(), 0);
+        for (int i = 0; i < objects; i++) {
+            digits[i] = discretizedValue<S>(col, order[i] * lanes + d % lanes);
+            start[digits[i] + 1]++;
+        }
+        std::partial_sum(start.begin(), start.end(), start.begin());
+        for (int i = 0; i < objects; i++) {
+            const int k = start[digits[i]]++;
+            keys[k] = prefix[i] + ((digits[i] * power) << 1);
+            if (sorted_order)
+                sorted_order[k] = order[i];
+        }
+    }
+
+private:
+    DiscretizedFile *in;
+    const int objects;
+    const int lanes;
+    const uint64_t base;
+};
+
+// Sorted keys of the tuple and its marginals; the keys of the prefix of
+// every discretization are kept sorted, with the order of their objects.
+
+template <DiscretizedStorage S>
+class SparseCounter {
+public:
+    SparseCounter(const AlgInfo &ai, DiscretizedFile *in, const DecisionTables &tables) :
+        sparse(in, ai.DIV),
+        tables(&tables),
+        dim(ai.DIM),
+        objects(in->info.objectCount),
+        base(ai.DIV + 1),
+        cc(std::pow((double)base, ai.DIM)),
+        cd(cc / base),
+        powers(ai.DIM, 1),
+        prefixes((std::size_t)ai.DISC * objects),
+        orders((std::size_t)ai.DISC * objects),
+        digits(objects),
+        start(base + 1),
+        keys(objects),
+        reduced(objects),
+        prefix(nullptr) {
+        for (int vv = 1; vv < dim; vv++)
+            powers[vv] = powers[vv - 1] * base;
+    }
+
+    int columns() const {
+        return 1;
+    }
+
+    void selectColumn(int) {}
+
+    void computePrefix(const VarsTuple &v, int d) {
+        sparse.tupleKeys(v, dim - 1, d, prefixes.data() + (std::size_t)d * objects);
+        sparse.sortKeys(prefixes.data() + (std::size_t)d * objects, orders.data() + (std::size_t)d * objects);
+    }
+
+    void countTuple(const VarsTuple &v, int d) {
+        prefix = prefixes.data() + (std::size_t)d * objects;
+        sparse.addVariable(prefix, orders.data() + (std::size_t)d * objects, v.get(dim - 1), d,
+                           powers[dim - 1], digits, start, keys.data());
+    }
+
+    float informationGain() {
+        return sortedInformationGain(tables->full, cc, keys.data(), objects);
+    }
+
+    float marginalInformationGain(int vv) {
+        if (vv == dim - 1)
+            return sortedInformationGain(tables->marginal, cd, prefix, objects);
+        reduceKeys(keys, powers[vv], base, reduced);
+        return sparseInformationGain(tables->marginal, cd, reduced);
+    }
+
+    void countSubtuple(const VarsTuple &s, int d) {
+        sparse.tupleKeys(s, dim - 1, d, keys.data());
+    }
+
+    float subtupleInformationGain() {
+        return sparseInformationGain(tables->marginal, cd, keys);
+    }
+
+private:
+    SparseKeys<S> sparse;
+    const DecisionTables *tables;
+    const int dim;
+    const int objects;
+    const uint64_t base;
+    const double cc;
+    const double cd;
+    std::vector<uint64_t> powers;
+    std::vector<uint64_t> prefixes;
+    std::vector<int> orders;
+    std::vector<int> digits;
+    std::vector<int> start;
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> reduced;
+    const uint64_t *prefix;
+};
+
+template <DiscretizedStorage S>
+static void sparseMdfs(const AlgInfo &ai,
+                       DiscretizedFile *in,
+                       MDFSOutput &out) {
+    const DecisionTables tables(in->classCounts(), ai.pseudo, ai.DIV, ai.DIM);
+    mdfs_scheme(ai, in, SparseCounter<S>(ai, in, tables), out);
+}
+
+// Sorted keys of the tuple and its marginals for the columns of a batch.
+// A run of equal keys (but for the decision bit of the data, which is not
+// that of the columns) is a cell; its counters of a column are the sums of
+// the values of its objects in their planes (see mdfs_batch.h), summed for
+// all the columns at once, so the objects are kept in the order of the keys.
+// The IGs of every column are then found in one pass over the keys, those of
+// a marginal when the first column asks for it.
+
+template <DiscretizedStorage S>
+class SparseBatchCounter {
+public:
+    SparseBatchCounter(const AlgInfo &ai, DiscretizedFile *in, const ObjectBatch &batch, const ColumnTables &tables) :
+        sparse(in, ai.DIV),
+        batch(&batch),
+        tables(&tables),
+        dim(ai.DIM),
+        objects(in->info.objectCount),
+        size(batch.size),
+        base(ai.DIV + 1),
+        cc(std::pow((double)base, ai.DIM)),
+        cd(cc / base),
+        powers(ai.DIM, 1),
+        prefixes((std::size_t)ai.DISC * objects),
+        orders((std::size_t)ai.DISC * objects),
+        digits(objects),
+        start(base + 1),
+        keys(objects),
+        order(objects),
+        reduced(objects),
+        reduced_order(objects),
+        positions(objects),
+        sums((std::size_t)batch.planes * size),
+        igs(size),
+        marginal_igs((std::size_t)ai.DIM * size),
+        marginal_counted(ai.DIM),
+        prefix(nullptr),
+        prefix_order(nullptr),
+        j(0) {
+        for (int vv = 1; vv < dim; vv++)
+            powers[vv] = powers[vv - 1] * base;
+    }
+
+    int columns() const {
+        return size;
+    }
+
+    void computePrefix(const VarsTuple &v, int d) {
+        sparse.tupleKeys(v, dim - 1, d, prefixes.data() + (std::size_t)d * objects);
+        sparse.sortKeys(prefixes.data() + (std::size_t)d * objects, orders.data() + (std::size_t)d * objects);
+    }
+
+    void countTuple(const VarsTuple &v, int d) {
+        prefix = prefixes.data() + (std::size_t)d * objects;
+        prefix_order = orders.data() + (std::size_t)d * objects;
+        sparse.addVariable(prefix, prefix_order, v.get(dim - 1), d,
+                           powers[dim - 1], digits, start, keys.data(), order.data());
+        columnInformationGains(keys.data(), order.data(), cc, false, igs.data());
+        std::fill(marginal_counted.begin(), marginal_counted.end(), false);
+    }
+
+    void selectColumn(int column) {
+        j = column;
+    }
+
+    float informationGain() {
+        return igs[j];
+    }
+
+    float marginalInformationGain(int vv) {
+        float *ig = marginal_igs.data() + (std::size_t)vv * size;
+        if (!marginal_counted[vv]) {
+            if (vv == dim - 1) {
+                columnInformationGains(prefix, prefix_order, cd, true, ig);
+            } else {
+                reduceKeys(keys, powers[vv], base, reduced);
+                sparse.sortKeys(reduced.data(), positions.data());
+                for (int i = 0; i < objects; i++)
+                    reduced_order[i] = order[positions[i]];
+                columnInformationGains(reduced.data(), reduced_order.data(), cd, true, ig);
+            }
+            marginal_counted[vv] = true;
+        }
+        return ig[j];
+    }
+
+    void countSubtuple(const VarsTuple &s, int d) {
+        sparse.tupleKeys(s, dim - 1, d, keys.data());
+        sparse.sortKeys(keys.data(), order.data());
+        columnInformationGains(keys.data(), order.data(), cd, true, igs.data());
+    }
+
+    float subtupleInformationGain() {
+        return igs[j];
+    }
+
+private:
+    const EntropyTable &table(int column, bool marginal) const {
+        return marginal ? (*tables)[column].marginal : (*tables)[column].full;
+    }
+
+    // IGs of every column for the sorted keys of the objects sorted_order,
+    // as sortedInformationGain finds them
+    void columnInformationGains(const uint64_t *sorted, const int *sorted_order, double cells, bool marginal, float *ig) {
+        std::fill(ig, ig + size, 0.0f);
+        double occupied = 0;
+        for (int i = 0; i < objects; occupied++) {
+            const uint64_t b = sorted[i] >> 1;
+            std::fill(sums.begin(), sums.end(), 0);
+            uint32_t n = 0;
+            for (; i < objects && (sorted[i] >> 1) == b; i++, n++) {
+                const int o = sorted_order[i];
+                const uint16_t *y = batch->values.data() + (std::size_t)o * size;
+                uint32_t *m = sums.data() + (std::size_t)batch->plane[o] * size;
+                #pragma omp simd
+                for (int c = 0; c < size; c++)
+                    m[c] += y[c];
+            }
+            for (int c = 0; c < size; c++)
+                ig[c] += cellInformationGain(table(c, marginal), c, n);
+        }
+        for (int c = 0; c < size; c++) {
+            const EntropyTable &t = table(c, marginal);
+            float empty = -t.f[0];
+            for (int k = 0; k < t.classes; k++)
+                empty += t.fc[k][0];
+            ig[c] += (float)((cells - occupied) * empty);
+        }
+    }
+
+    // of the cell of n objects whose sums are counted, for the column c;
+    // class 0 of decisions is the rest of the objects
+    float cellInformationGain(const EntropyTable &t, int c, uint32_t n) const {
+        if (batch->weighted()) {
+            float ig = 0.0f;
+            uint32_t total = 0;
+            for (int k = 0; k < batch->classes; k++) {
+                const uint32_t nk = sums[(std::size_t)k * size + c];
+                ig += t.fc[k][nk];
+                total += nk;
+            }
+            return ig - t.f[total];
+        }
+        const uint32_t n1 = sums[c];
+        return t.fc[0][n - n1] + t.fc[1][n1] - t.f[n];
+    }
+
+    SparseKeys<S> sparse;
+    const ObjectBatch *batch;
+    const ColumnTables *tables;
+    const int dim;
+    const int objects;
+    const int size;
+    const uint64_t base;
+    const double cc;
+    const double cd;
+    std::vector<uint64_t> powers;
+    std::vector<uint64_t> prefixes;
+    std::vector<int> orders;
+    std::vector<int> digits;
+    std::vector<int> start;
+    std::vector<uint64_t> keys;
+    std::vector<int> order;
+    std::vector<uint64_t> reduced;
+    std::vector<int> reduced_order;
+    std::vector<int> positions;
+    std::vector<uint32_t> sums;
+    std::vector<float> igs;
+    std::vector<float> marginal_igs;
+    std::vector<bool> marginal_counted;
+    const uint64_t *prefix;
+    const int *prefix_order;
+    int j;
+};
+
+template <DiscretizedStorage S>
+static void sparseBatchMdfs(const AlgInfo &ai,
+                            DiscretizedFile *in,
+                            const ObjectBatch &batch,
+                            MDFSOutput &out) {
+    const ColumnTables tables(batch, ai.pseudo, ai.DIV, ai.DIM);
+    mdfs_scheme(ai, in, SparseBatchCounter<S>(ai, in, batch, tables), out);
+}
+
+bool sparseContingency(const AlgInfo &ai, int objects) {
+    return std::pow((double)(ai.DIV + 1), ai.DIM) > SPARSE_BUCKETS_PER_OBJECT * std::max(objects, 1)
+        || !cellCountFits(ai.DIV, ai.DIM, 2);
+}
+
+void SparseMDFS(const AlgInfo &ai,
+                DiscretizedFile *in,
+                MDFSOutput &out) {
+    switch (in->info.storage) {
+        case DiscretizedStorage::Bit:
+            sparseMdfs<DiscretizedStorage::Bit>(ai, in, out);
+            break;
+        case DiscretizedStorage::Nibble:
+            sparseMdfs<DiscretizedStorage::Nibble>(ai, in, out);
+            break;
+        case DiscretizedStorage::Byte:
+            sparseMdfs<DiscretizedStorage::Byte>(ai, in, out);
+            break;
+    }
+}
+
+void SparseBatchMDFS(const AlgInfo &ai,
+                     DiscretizedFile *in,
+                     const ObjectBatch &batch,
+                     MDFSOutput &out) {
+    switch (in->info.storage) {
+        case DiscretizedStorage::Bit:
+            sparseBatchMdfs<DiscretizedStorage::Bit>(ai, in, batch, out);
+            break;
+        case DiscretizedStorage::Nibble:
+            sparseBatchMdfs<DiscretizedStorage::Nibble>(ai, in, batch, out);
+            break;
+        case DiscretizedStorage::Byte:
+            sparseBatchMdfs<DiscretizedStorage::Byte>(ai, in, batch, out);
+            break;
+    }
+}
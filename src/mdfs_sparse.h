@@ -0,0 +1,28 @@
+#ifndef MDFS_SPARSE
+#define MDFS_SPARSE
+
+#include "mdfs_batch.h"
+#include "mdfs_common.h"
+
+// Contingency tables with many more buckets than objects, (DIV+1)^DIM
+// above SPARSE_BUCKETS_PER_OBJECT per object, are mostly empty; they are
+// counted by sorting the bucket indices of objects instead. So are the tables
+// too large for the int counters of the dense kernels.
+// The kernel reads any storage and lanes, so it can take over from any other.
+
+const double SPARSE_BUCKETS_PER_OBJECT = 4.0;
+
+bool sparseContingency(const AlgInfo &ai, int objects);
+
+void SparseMDFS(const AlgInfo &ai,
+                DiscretizedFile *in,
+                MDFSOutput &out);
+
+// The same for the columns of a batch (see BatchMDFS), of any number of
+// classes and tables of any size
+void SparseBatchMDFS(const AlgInfo &ai,
+                     DiscretizedFile *in,
+                     const ObjectBatch &batch,
+                     MDFSOutput &out);
+
+#endif
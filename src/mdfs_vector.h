@@ -6,174 +6,503 @@
 #include <vector>
 #include <numeric>
 #include <cmath>
+#include <immintrin.h>
 
 #include "mdfs_common.h"
+#include "mdfs_scheme.h"
 #include "vec_stats.h"
-#include "vec_discretizedfile.h"
 
-#define CONTAINS(x, y) (std::find((x).begin(), (x).end(), (y)) != (x).end())
+// The vector kernels are included by avxmdfs.cpp and avx2mdfs.cpp within a
+// target region (#pragma GCC target, or its clang attribute), not built
+// with -mavx/-mavx2: the inline functions and templates of the shared
+// headers and of the standard library, which those files include before
+// the region, are emitted by the scalar files too, and the linker keeps
+// one copy of each, so a copy compiled for AVX would then run under the
+// scalar kernels. What is defined here is internal to the including file.
 
-template<typename T,
-	 T (*MUL) (T, T),
-	 T (*ADD) (T, T)>
-inline T my_fma(T a, T b, T c)
+namespace {
+
+// Every lane counts into its own integer histogram (see vec_stats.h),
+// so the lanes of a vector of bucket indices never conflict
+
+template <int VL,
+          typename Td,
+          Td(*SETd)(int a),
+          Td(*MULd)(Td a, Td b),
+          Td(*ADDd)(Td a, Td b),
+          Td(*LOADd)(const uint8_t *pack, int o),
+          typename C>
+inline void vectorCountTuple(int div,
+                             int dim,
+                             int objects,
+                             const uint8_t * const *packs,
+                             const int *decision,
+                             C *counters,
+                             int cc,
+                             int classes)
 {
-    return ADD(MUL(a, b), c);
+    std::memset(counters, 0, sizeof(C) * VL * cc * classes);
+
+    for (int o = 0; o < objects; ++o) {
+        Td b = SETd(0);
+        for (int vv = dim-1; vv >= 0; vv--) {
+            b = MULd(b, SETd(div + 1));
+            b = ADDd(b, LOADd(packs[vv], o));
+        }
+        int dec = decision[o];
+        int32_t buckets[VL];
+        std::memcpy(buckets, &b, sizeof(b));
+        for (int bs = 0; bs < VL; bs++) {
+            counters[(dec * cc + buckets[bs]) * VL + bs]++;
+        }
+    }
 }
 
+// Partial bucket indices of the first DIM-1 variables (see mdfs_scalar.cpp)
+
 template <int VL,
-          typename T,
-          T(*SET)(float),
-          T(*MUL)(T a, T b),
-          T(*ADD)(T a, T b),
-          T(*SUB)(T a, T b),
-          T (*FMA)(T a, T b, T c),
-          T (*LOG)(T a),
           typename Td,
           Td(*SETd)(int a),
           Td(*MULd)(Td a, Td b),
-          Td(*ADDd)(Td a, Td b)>
-void vectorMdfs_scheme(AlgInfo ai,
-                       VectorDiscretizedFile<VL> *in,
-                       MDFSOutput &out,
-                       int c0,
-                       int c1)
+          Td(*ADDd)(Td a, Td b),
+          Td(*LOADd)(const uint8_t *pack, int o)>
+inline void vectorComputePrefix(int div,
+                                int dim,
+                                int objects,
+                                const uint8_t * const *packs,
+                                const int *decision,
+                                int cc,
+                                Td *prefix)
 {
-    int cc = std::pow(ai.DIV + 1, ai.DIM);
-    int cd = cc / (ai.DIV + 1);
-
-    float sp0  = (float)c0 / (c1 + c0);
-          sp0 *= ai.pseudo;
-          sp0 /= cc;
-    float sp1  = (float)c1 / (c1 + c0);
-          sp1 *= ai.pseudo;
-          sp1 /= cc;
-
-    T p0 = SET(sp0);
-    T p1 = SET(sp1);
-
-    T* ig = (T*)_mm_malloc(sizeof(T) * ai.DISC/VL * ai.DIM, sizeof(T));
-    float* dig = new float[ai.DIM];
-
-    VarsTuple v(ai.DIM, in->info.variableCount);
-    while (!v.done()) {
-        std::list<int> current_interesting_vars;
-        std::set_intersection(
-            v.begin(), v.end(),
-            ai.interesting_vars.begin(), ai.interesting_vars.end(),
-            std::back_inserter(current_interesting_vars));
-        if (!ai.interesting_vars.empty() && current_interesting_vars.empty()) {
-            v.next();
-            continue;
+    for (int o = 0; o < objects; ++o) {
+        Td b = SETd(0);
+        for (int vv = dim-2; vv >= 0; vv--) {
+            b = MULd(b, SETd(div + 1));
+            b = ADDd(b, LOADd(packs[vv], o));
         }
+        prefix[o] = ADDd(b, SETd(decision[o] * cc));
+    }
+}
 
-        #pragma omp parallel for
-        for (int d = 0; d < in->info.discretizations/VL; ++d) {
-            T* counters = (T*)_mm_malloc(sizeof(T) * cc * 2, sizeof(T));
-            T* reduced = (T*)_mm_malloc(sizeof(T) * cd * 2, sizeof(T));
+template <int VL,
+          typename Td,
+          Td(*SETd)(int a),
+          Td(*MULd)(Td a, Td b),
+          Td(*ADDd)(Td a, Td b),
+          Td(*LOADd)(const uint8_t *pack, int o),
+          typename C>
+inline void vectorCountWithPrefix(int begin,
+                                  int end,
+                                  const Td *prefix,
+                                  const uint8_t *last,
+                                  int stride,
+                                  C *counters)
+{
+    const Td vstride = SETd(stride);
+    for (int o = begin; o < end; ++o) {
+        Td b = ADDd(prefix[o], MULd(LOADd(last, o), vstride));
+        int32_t buckets[VL];
+        std::memcpy(buckets, &b, sizeof(b));
+        for (int bs = 0; bs < VL; bs++) {
+            counters[buckets[bs] * VL + bs]++;
+        }
+    }
+}
 
-            std::memset(counters, 0, sizeof(float) * VL * cc * 2);
+// ig is stored per variable: ig[vv * DISC/VL + pack]
 
-            for (int o = 0; o < in->info.objectCount; ++o) {
-                Td b = SETd(0);
-                for (int vv = ai.DIM-1; vv >= 0; vv--) {
-                    b = MULd(b, SETd(ai.DIV + 1));
-                    b = ADDd(b, ((Td *)in->getVDpack(v.get(vv), d))[o]);
+template <int VL,
+          typename T,
+          T(*SET)(float),
+          T(*ADD)(T a, T b)>
+inline void vectorReduceDiscretizations(const AlgInfo &ai, const T *ig, float *dig)
+{
+    switch (ai.rm) {
+        case reduceMethod::RM_AVG:
+            for (int vv = 0; vv < ai.DIM; vv++) {
+                T sum = SET(0.0f);
+                for (int i = 0; i < ai.DISC/VL; ++i) {
+                    sum = ADD(sum, ig[vv * ai.DISC/VL + i]);
                 }
-                int dec = in->decision[o];
-                int32_t * buckets = (int32_t*)&b;
-                for (int bs = 0; bs < VL; bs++) {
-                    ((float*)&(counters[dec * cc + buckets[bs]]))[bs] += 1.0f;
+                dig[vv] = 0.0f;
+                for (int i = 0; i < VL; i++) {
+                    dig[vv] += ((float *)&sum)[i];
                 }
+                dig[vv] /= ai.DISC;
             }
-
-            for (int b = 0; b < cc; ++b) {
-                counters[0 * cc + b] = ADD(counters[0 * cc + b], p0);
-                counters[1 * cc + b] = ADD(counters[1 * cc + b], p1);
+            break;
+        case reduceMethod::RM_MAX:
+            for (int vv = 0; vv < ai.DIM; vv++) {
+                dig[vv] = 0.0f;
+                for (int i = 0; i < ai.DISC/VL; ++i) {
+                    T tmp = ig[vv * ai.DISC/VL + i];
+                    for (int ii = 0; ii < VL; ii++) {
+                        dig[vv] = std::max(((float *)&tmp)[ii], dig[vv]);
+                    }
+                }
             }
+            break;
+        default:
+            break;
+    }
+}
 
-            T ign = vectorInformationGain<T, SET, MUL, ADD, FMA, LOG>(cc, counters, counters+cc);
+// Sub-tuple IGs of a pack of VL discretizations are stored next to each other
+template <int VL,
+          typename T,
+          T(*SET)(float),
+          T(*ADD)(T a, T b),
+          T(*SUB)(T a, T b),
+          typename Td,
+          Td(*SETd)(int a),
+          Td(*MULd)(Td a, Td b),
+          Td(*ADDd)(Td a, Td b),
+          Td(*LOADd)(const uint8_t *pack, int o),
+          typename C,
+          Td(*LOADC)(const C *cell),
+          T(*GATHER)(const float *table, Td idx)>
+void vectorFillSubtupleIGs(const AlgInfo &ai,
+                           DiscretizedFile *in,
+                           const EntropyTable &marginal,
+                           SubtupleIGs *memo)
+{
+    const int dim = ai.DIM - 1;
+    const int cd = cellCount(ai.DIV, dim);
+    const TupleSchedule schedule(dim, in->info.variableCount, ai.block_vars);
+    const long chunks = schedule.chunks();
 
-            for (int vv = 0; vv < ai.DIM; vv++) {
-                vectorReduceCounter<T, SET, MUL, ADD, FMA, LOG>(ai.DIV, counters, ai.DIM, reduced, vv + 1);
-                vectorReduceCounter<T, SET, MUL, ADD, FMA, LOG>(ai.DIV, counters+cc, ai.DIM, reduced+cd, vv + 1);
-                T igg = vectorInformationGain<T, SET, MUL, ADD, FMA, LOG>(cd, reduced, reduced+cd);
-                T igv = SUB(ign, igg);
-                ig[vv * ai.DISC/VL + d] = igv;
-            }
+    #pragma omp parallel
+    {
+        C* counters = new C[VL * cd * marginal.classes];
+        std::vector<const uint8_t*> packs(dim);
 
-            _mm_free(counters);
-            _mm_free(reduced);
+        #pragma omp for schedule(dynamic)
+        for (long chunk = 0; chunk < chunks; ++chunk) {
+            VarsTuple v = schedule.first(chunk);
+            for (std::size_t t = 0; t < schedule.chunkSize() && !v.done(); ++t, v.next()) {
+                float* igg = memo->get(memo->rank(v));
+                for (int d = 0; d < in->info.discretizations/VL; ++d) {
+                    for (int vv = 0; vv < dim; vv++) {
+                        packs[vv] = in->getVD(v.get(vv), d * VL);
+                    }
+                    vectorCountTuple<VL, Td, SETd, MULd, ADDd, LOADd, C>(ai.DIV, dim, in->info.objectCount, packs.data(), in->decision.data(), counters, cd, marginal.classes);
+                    T vigg = vectorInformationGain<VL, T, SET, ADD, SUB, Td, ADDd, C, LOADC, GATHER>(marginal, cd, counters);
+                    std::memcpy(igg + d * VL, &vigg, sizeof(T));
+                }
+            }
         }
 
-        switch (ai.rm) {
-            case reduceMethod::RM_AVG:
-                for (int vv = 0; vv < ai.DIM; vv++) {
-                    T sum = SET(0.0f);
-                    for (int i = 0; i < ai.DISC/VL; ++i) {
-                        sum = ADD(sum, ig[vv * ai.DISC/VL + i]);
+        delete[] counters;
+    }
+}
+
+template <int VL,
+          typename T,
+          T(*SET)(float),
+          T(*ADD)(T a, T b),
+          T(*SUB)(T a, T b),
+          typename Td,
+          Td(*SETd)(int a),
+          Td(*MULd)(Td a, Td b),
+          Td(*ADDd)(Td a, Td b),
+          Td(*LOADd)(const uint8_t *pack, int o),
+          typename C,
+          Td(*LOADC)(const C *cell),
+          T(*GATHER)(const float *table, Td idx),
+          typename Shape = RuntimeShape>
+void vectorMdfs_scheme(const AlgInfo &ai,
+                       DiscretizedFile *in,
+                       MDFSOutput &out,
+                       const std::vector<int> &class_counts)
+{
+    const Shape shape(ai);
+    const int DIM = shape.dim();
+    const int DIV = shape.div();
+    const int K = shape.classes();
+    const int cc = shape.cells();
+    const int cd = cc / (DIV + 1);
+
+    const DecisionTables tables(class_counts, ai.pseudo, DIV, DIM);
+    const EntropyTable &full = tables.full;
+    const EntropyTable &marginal = tables.marginal;
+
+    std::unique_ptr<SubtupleIGs> memo;
+    if (SubtupleIGs::useful(ai, in->info.variableCount)) {
+        memo.reset(new SubtupleIGs(DIM - 1, in->info.variableCount, ai.DISC));
+        vectorFillSubtupleIGs<VL, T, SET, ADD, SUB, Td, SETd, MULd, ADDd, LOADd, C, LOADC, GATHER>(ai, in, marginal, memo.get());
+    }
+
+    std::unique_ptr<TupleBounds> bounds;
+    if (TupleBounds::useful(ai, out))
+        bounds.reset(new TupleBounds(ai, in));
+
+    const TupleSchedule schedule(DIM, in->info.variableCount, ai.block_vars, ai.interesting_vars);
+    const long chunks = schedule.chunks();
+
+    // Tuples sharing their prefix are counted in blocks of up to
+    // tile_tuples, over tiles of objects small enough for the prefix tile,
+    // the last-variable tiles and the counters of the block to stay in cache.
+    // The prefix is then streamed from memory once per block, not per tuple.
+    const int tile_tuples = std::max(ai.tile_tuples, 1);
+    const int tile_objects = tile_tuples > 1 ? TILE_OBJECTS : in->info.objectCount;
+
+    #pragma omp parallel
+    {
+        MDFSOutput thread_out(out, in->info.variableCount);
+
+        T* ig = (T*)_mm_malloc(sizeof(T) * ai.DISC/VL * DIM * tile_tuples, sizeof(T));
+        float* dig = new float[DIM];
+        C* counters = new C[VL * cc * K * tile_tuples];
+        C* reduced = new C[VL * cd * K];
+        std::vector<const uint8_t*> packs(DIM);
+        std::vector<float*> iggs(DIM);
+        Td* prefixes = (Td*)_mm_malloc(sizeof(Td) * ai.DISC/VL * in->info.objectCount, sizeof(Td));
+        std::vector<int> prefix_vars(DIM - 1);
+        bool prefix_valid = false;
+        std::vector<VarsTuple> block;
+        std::vector<int> current_interesting_vars;
+        std::vector<float> bound(DIM * ai.DISC);
+        std::vector<float> dbound(DIM);
+
+        auto countBlock = [&]() {
+            const VarsTuple &first = block.front();
+            if (!prefix_valid || !std::equal(prefix_vars.begin(), prefix_vars.end(), first.begin())) {
+                std::copy(first.begin(), first.end() - 1, prefix_vars.begin());
+                prefix_valid = true;
+                for (int d = 0; d < in->info.discretizations/VL; ++d) {
+                    for (int vv = 0; vv < DIM - 1; vv++) {
+                        packs[vv] = in->getVD(first.get(vv), d * VL);
                     }
-                    dig[vv] = 0.0f;
-                    for (int i = 0; i < VL; i++) {
-                        dig[vv] += ((float *)&sum)[i];
+                    vectorComputePrefix<VL, Td, SETd, MULd, ADDd, LOADd>(DIV, DIM, in->info.objectCount, packs.data(), in->decision.data(), cc,
+                                                                         prefixes + (std::size_t)d * in->info.objectCount);
+                }
+            }
+
+            const int n = block.size();
+            for (int d = 0; d < in->info.discretizations/VL; ++d) {
+                const Td *prefix = prefixes + (std::size_t)d * in->info.objectCount;
+                std::memset(counters, 0, sizeof(C) * VL * cc * K * n);
+                for (int o = 0; o < in->info.objectCount; o += tile_objects) {
+                    int end = std::min(o + tile_objects, in->info.objectCount);
+                    for (int t = 0; t < n; t++) {
+                        vectorCountWithPrefix<VL, Td, SETd, MULd, ADDd, LOADd, C>(o, end, prefix, in->getVD(block[t].get(DIM - 1), d * VL),
+                                                                                  cd, counters + t * VL * cc * K);
                     }
-                    dig[vv] /= ai.DISC;
                 }
-                break;
-            case reduceMethod::RM_MAX:
-                for (int vv = 0; vv < ai.DIM; vv++) {
-                    dig[vv] = 0.0f;
-                    for (int i = 0; i < ai.DISC/VL; ++i) {
-                        T tmp = ig[vv * ai.DISC/VL + i];
-                        for (int ii = 0; ii < VL; ii++) {
-                            dig[vv] = std::max(((float *)&tmp)[ii], dig[vv]);
+
+                for (int t = 0; t < n; t++) {
+                    C *tc = counters + t * VL * cc * K;
+                    T ign = vectorInformationGain<VL, T, SET, ADD, SUB, Td, ADDd, C, LOADC, GATHER>(full, cc, tc);
+
+                    if (memo) {
+                        for (int vv = 0; vv < DIM; vv++) {
+                            iggs[vv] = memo->get(memo->rank(block[t], vv));
                         }
                     }
+
+                    for (int vv = 0; vv < DIM; vv++) {
+                        T igg;
+                        if (memo) {
+                            std::memcpy(&igg, iggs[vv] + d * VL, sizeof(T));
+                        } else {
+                            for (int k = 0; k < K; k++) {
+                                vectorReduceCounter<VL, C>(DIV, tc + k * VL * cc, DIM, reduced + k * VL * cd, vv + 1);
+                            }
+                            igg = vectorInformationGain<VL, T, SET, ADD, SUB, Td, ADDd, C, LOADC, GATHER>(marginal, cd, reduced);
+                        }
+                        T igv = SUB(ign, igg);
+                        ig[(t * DIM + vv) * ai.DISC/VL + d] = igv;
+                    }
                 }
-                break;
-            default:
-                break;
-        }
+            }
 
-        switch (out.type) {
-            case MDFSOutputType::MaxIGs:
-                for (int vv = 0; vv < ai.DIM; vv++) {
-                    out.UpdateMaxIG(v.get(vv), dig[vv]);
+            for (int t = 0; t < n; t++) {
+                vectorReduceDiscretizations<VL, T, SET, ADD>(ai, ig + t * DIM * ai.DISC/VL, dig);
+                skipTuple(ai, block[t], current_interesting_vars);
+                reportTuple(ai, block[t], current_interesting_vars, dig, thread_out);
+            }
+
+            block.clear();
+        };
+
+        #pragma omp for schedule(dynamic)
+        for (long chunk = 0; chunk < chunks; ++chunk) {
+            VarsTuple v = schedule.first(chunk);
+            for (std::size_t t = 0; t < schedule.chunkSize() && !v.done(); ++t, v.next()) {
+                if (skipTuple(ai, v, current_interesting_vars)) {
+                    continue;
                 }
-                break;
-            case MDFSOutputType::MatchingTuples:
-                for (int vv = 0; vv < ai.DIM; vv++) {
-                    if (dig[vv] > ai.ig_thr && (current_interesting_vars.empty() || CONTAINS(current_interesting_vars, v.get(vv)))) {
-                        out.AddTuple(v.get(vv), dig[vv], v);
-                    }
+
+                if (bounds && bounds->prune(ai, v, current_interesting_vars, memo.get(), bound.data(), dbound.data())) {
+                    thread_out.CountPruned();
+                    continue;
+                }
+
+                if (!block.empty() && ((int)block.size() == tile_tuples ||
+                                       !std::equal(v.begin(), v.end() - 1, block.front().begin()))) {
+                    countBlock();
                 }
-                break;
+                block.push_back(v);
+            }
+            if (!block.empty()) {
+                countBlock();
+            }
         }
 
-        v.next();
-    }
+        _mm_free(ig);
+        delete[] dig;
+        delete[] counters;
+        delete[] reduced;
+        _mm_free(prefixes);
 
-    _mm_free(ig);
-    delete[] dig;
+        #pragma omp critical
+        out.Merge(thread_out);
+    }
 }
 
 template <int VL,
           typename T,
           T(*SET)(float),
-          T(*MUL)(T a, T b),
           T(*ADD)(T a, T b),
           T(*SUB)(T a, T b),
-          T (*FMA)(T a, T b, T c),
-          T (*LOG)(T a),
           typename Td,
           Td(*SETd)(int a),
           Td(*MULd)(Td a, Td b),
-          Td(*ADDd)(Td a, Td b)>
-void vectorMdfs(AlgInfo ai,
-                VectorDiscretizedFile<VL> *in,
+          Td(*ADDd)(Td a, Td b),
+          Td(*LOADd)(const uint8_t *pack, int o),
+          typename C,
+          Td(*LOADC)(const C *cell),
+          T(*GATHER)(const float *table, Td idx),
+          typename Shape = RuntimeShape>
+void vectorMdfs(const AlgInfo &ai,
+                DiscretizedFile *in,
                 MDFSOutput &out)
 {
-    vectorMdfs_scheme<VL, T, SET, MUL, ADD, SUB, FMA, LOG, Td, SETd, MULd, ADDd>(ai, in, out, in->c0(), in->c1());
+    vectorMdfs_scheme<VL, T, SET, ADD, SUB, Td, SETd, MULd, ADDd, LOADd, C, LOADC, GATHER, Shape>(ai, in, out, in->classCounts());
+}
+
+// Object lanes: VL consecutive objects of one discretization at a time, so
+// any number of discretizations is vectorized. LOADd reads VL consecutive
+// values of a column just as it reads the VL lanes of an interleaved object.
+// The lanes count into private sub-histograms, summed once per tuple, and
+// the last group scatters only the lanes of existing objects (columns are
+// padded, so it is safe to load).
+// Lanes holds the integer vector type and its operations, as the vector
+// type (or a function of it) as a class template argument would lose its
+// attributes:
+//
+//   static const int VL
+//   typedef Td
+//   static Td SETd(int a), MULd(Td a, Td b), ADDd(Td a, Td b)
+//   static Td LOADd(const uint8_t *pack, int o)
+
+template <typename Lanes>
+class ObjectLaneCounter {
+    static const int VL = Lanes::VL;
+    typedef typename Lanes::Td Td;
+    static Td SETd(int a) { return Lanes::SETd(a); }
+    static Td MULd(Td a, Td b) { return Lanes::MULd(a, b); }
+    static Td ADDd(Td a, Td b) { return Lanes::ADDd(a, b); }
+    static Td LOADd(const uint8_t *pack, int o) { return Lanes::LOADd(pack, o); }
+public:
+    ObjectLaneCounter(int objects, int cc, int classes) : objects(objects), cc(cc), classes(classes), lanes(VL * cc * classes, 0) {}
+
+    std::size_t prefixLength() const {
+        return groups() * VL;
+    }
+
+    void countTuple(int div,
+                    int dim,
+                    const uint8_t * const *cols,
+                    const int *decision,
+                    uint32_t *counters) {
+        for (int g = 0; g < groups(); ++g) {
+            Td b = SETd(0);
+            for (int vv = dim-1; vv >= 0; vv--) {
+                b = MULd(b, SETd(div + 1));
+                b = ADDd(b, LOADd(cols[vv], g));
+            }
+            scatter(ADDd(b, decisionPlanes(decision, g)), std::min(VL, objects - g * VL));
+        }
+        sum(counters);
+    }
+
+    void computePrefix(int div,
+                       int dim,
+                       const uint8_t * const *cols,
+                       const int *decision,
+                       uint32_t *prefix) const {
+        for (int g = 0; g < groups(); ++g) {
+            Td b = SETd(0);
+            for (int vv = dim-2; vv >= 0; vv--) {
+                b = MULd(b, SETd(div + 1));
+                b = ADDd(b, LOADd(cols[vv], g));
+            }
+            b = ADDd(b, decisionPlanes(decision, g));
+            std::memcpy(prefix + g * VL, &b, sizeof(b));
+        }
+    }
+
+    void countWithPrefix(const uint32_t *prefix,
+                         const uint8_t *last,
+                         int stride,
+                         uint32_t *counters) {
+        const Td vstride = SETd(stride);
+        const int full = objects / VL;
+        for (int g = 0; g < full; ++g) {
+            Td p;
+            std::memcpy(&p, prefix + g * VL, sizeof(p));
+            scatter(ADDd(p, MULd(LOADd(last, g), vstride)), VL);
+        }
+        if (objects % VL) {
+            Td p;
+            std::memcpy(&p, prefix + full * VL, sizeof(p));
+            scatter(ADDd(p, MULd(LOADd(last, full), vstride)), objects % VL);
+        }
+        sum(counters);
+    }
+
+private:
+    int groups() const {
+        return (objects + VL - 1) / VL;
+    }
+
+    Td decisionPlanes(const int *decision, int g) const {
+        int32_t planes[VL];
+        for (int l = 0; l < VL; l++) {
+            int o = g * VL + l;
+            planes[l] = o < objects ? decision[o] * cc : 0;
+        }
+        Td p;
+        std::memcpy(&p, planes, sizeof(p));
+        return p;
+    }
+
+    void scatter(Td b, int valid) {
+        int32_t buckets[VL];
+        std::memcpy(buckets, &b, sizeof(b));
+        for (int bs = 0; bs < valid; bs++) {
+            lanes[buckets[bs] * VL + bs]++;
+        }
+    }
+
+    void sum(uint32_t *counters) {
+        for (int c = 0; c < classes * cc; c++) {
+            uint32_t s = 0;
+            for (int l = 0; l < VL; l++) {
+                s += lanes[c * VL + l];
+                lanes[c * VL + l] = 0;
+            }
+            counters[c] = s;
+        }
+    }
+
+    const int objects;
+    const int cc;
+    const int classes;
+    std::vector<uint32_t> lanes;
+};
+
 }
 
 #endif
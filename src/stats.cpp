@@ -1,27 +1,55 @@
+#include <algorithm>
 #include <cmath>
-#include <cstring>
 
-void reduceCounter(int div, float *in, int dim, float *out, int reduced) {
-    div += 1;
-    int rstride = std::pow(div, (reduced - 1));
-    int size = std::pow(div, dim);
-    int v = 0;
-    std::memset(out, 0, sizeof(float) * std::pow(div, (dim - 1)));
-    for (int c = 0; c < size; c += rstride * div) {
-        for (int s = 0; s < rstride; s++, v++) {
-            for (int d = 0; d < div; d++) {
-                out[v] += in[c + s + (d * rstride)];
-            }
+#include "stats.h"
+
+// c log2(c / objects): the normalization cancels out in f0 + f1 - f,
+// but keeps the terms as small as the ones of c0 log2(c0 / c).
+// A class without objects has no pseudocount, and its empty cells add nothing.
+static float entropyTerm(double c, double objects) {
+    return c > 0 ? c * std::log2(c / objects) : 0.0;
+}
+
+EntropyTable::EntropyTable(int objects, float p0, float p1) :
+    EntropyTable(objects, std::vector<float>{ p0, p1 }) {}
+
+EntropyTable::EntropyTable(int objects, const std::vector<float> &p) :
+        classes(p.size()), fc(p.size(), std::vector<float>(objects + 1)), f(objects + 1) {
+    double total = std::max(objects, 1);
+    for (int n = 0; n <= objects; n++) {
+        double c = n;
+        for (int k = 0; k < classes; k++) {
+            fc[k][n] = entropyTerm(n + (double)p[k], total);
+            c += p[k];
         }
+        f[n] = entropyTerm(c, total);
+    }
+}
+
+float EntropyTable::informationGain(int counters, const uint32_t *n0, const uint32_t *n1) const {
+    const float *f0 = fc[0].data();
+    const float *f1 = fc[1].data();
+    float ig = 0.0f;
+    for (int i = 0; i < counters; i++) {
+        ig += f0[n0[i]] + f1[n1[i]] - f[n0[i] + n1[i]];
     }
+    return ig;
 }
 
-float informationGain(int counters, float *c0, float *c1) {
+float EntropyTable::informationGain(int counters, const uint32_t *n) const {
+    if (classes == 2)
+        return informationGain(counters, n, n + counters);
+
     float ig = 0.0f;
     for (int i = 0; i < counters; i++) {
-        float c = c0[i] + c1[i];
-        if (c0[i] != 0.0f) ig += (c0[i]) * std::log2(c0[i]/c);
-        if (c1[i] != 0.0f) ig += (c1[i]) * std::log2(c1[i]/c);
+        float terms = 0.0f;
+        uint32_t sum = 0;
+        for (int k = 0; k < classes; k++) {
+            const uint32_t nk = n[k * counters + i];
+            terms += fc[k][nk];
+            sum += nk;
+        }
+        ig += terms - f[sum];
     }
     return ig;
 }
@@ -1,8 +1,54 @@
 #ifndef STATS_H
 #define STATS_H
 
-void reduceCounter(int div, float *in, int dim, float *out, int stride);
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
 
-float informationGain(int counters, float *c0, float *c1);
+// (DIV+1)^dim cells of a dim-dimensional contingency table
+constexpr int cellCount(int div, int dim) {
+    return dim <= 0 ? 1 : (div + 1) * cellCount(div, dim - 1);
+}
+
+// Whether planes of (DIV+1)^dim counters each are indexed by int, as
+// cellCount and the dense kernels do
+inline bool cellCountFits(int div, int dim, int planes) {
+    return std::pow((double)(div + 1), dim) * planes <= INT_MAX;
+}
+
+// Sums the counters over the variable reduced (from 1). Inline, so that in the
+// kernels of fixed shapes the strides are constants and the loops unroll.
+inline void reduceCounter(int div, const uint32_t *in, int dim, uint32_t *out, int reduced) {
+    const int rstride = cellCount(div, reduced - 1);
+    const int size = cellCount(div, dim);
+    div += 1;
+    int v = 0;
+    std::memset(out, 0, sizeof(uint32_t) * (size / div));
+    for (int c = 0; c < size; c += rstride * div) {
+        for (int s = 0; s < rstride; s++, v++) {
+            for (int d = 0; d < div; d++) {
+                out[v] += in[c + s + (d * rstride)];
+            }
+        }
+    }
+}
+
+// Entropy terms of contingency table cells tabulated by the integer counts,
+// for cells with the pseudocount p[k] of every decision class k added:
+// informationGain = sum over cells of sum over classes fc[k][n_k] - f[sum of n_k]
+// The counters of the classes are planes of counters cells each.
+
+class EntropyTable {
+public:
+    EntropyTable(int objects, float p0, float p1);
+    EntropyTable(int objects, const std::vector<float> &p);
+    int classes;
+    std::vector<std::vector<float>> fc;
+    std::vector<float> f;
+    float informationGain(int counters, const uint32_t *n0, const uint32_t *n1) const;
+    float informationGain(int counters, const uint32_t *n) const;
+};
 
 #endif
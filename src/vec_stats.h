@@ -1,53 +1,65 @@
 #ifndef STATS_VECTOR_H
 #define STATS_VECTOR_H
 
-template <typename T,
-          T(*SET)(float),
-          T(*MUL)(T a, T b),
-          T(*ADD)(T a, T b),
-          T (*FMA)(T a, T b, T c),
-          T (*LOG)(T a)>
-void vectorReduceCounter(int div, T *in, int dim, T *out, int reduced) {
+#include <cmath>
+#include <cstring>
+
+#include "stats.h"
+
+// Included by mdfs_vector.h only, hence internal as well
+
+namespace {
+
+// Counters are lane-private integer histograms: counter i of lane l is in[i * VL + l]
+
+template <int VL,
+          typename C>
+inline void vectorReduceCounter(int div, const C *in, int dim, C *out, int reduced) {
+    const int rstride = cellCount(div, reduced - 1);
+    const int size = cellCount(div, dim);
     div += 1;
-    int rstride = std::pow(div, (reduced - 1));
-    int size = std::pow(div, dim);
     int v = 0;
-    std::memset(out, 0, sizeof(T) * std::pow(div, (dim - 1)));
+    std::memset(out, 0, sizeof(C) * VL * (size / div));
     for (int c = 0; c < size; c += rstride * div) {
         for (int s = 0; s < rstride; s++, v++) {
             for (int d = 0; d < div; d++) {
-                out[v] = ADD(in[c + s + (d * rstride)], out[v]);
+                for (int l = 0; l < VL; l++) {
+                    out[v * VL + l] += in[(c + s + (d * rstride)) * VL + l];
+                }
             }
         }
     }
 }
 
-template <typename T,
+// The counts of a cell are widened to integer lanes and the entropy terms
+// are gathered from the tables of EntropyTable; the classes are planes of
+// VL * counters counters
+
+template <int VL,
+          typename T,
           T(*SET)(float),
-          T(*MUL)(T a, T b),
           T(*ADD)(T a, T b),
-          T (*FMA)(T a, T b, T c),
-          T (*LOG)(T a)>
-T vectorInformationGain(int counters, T *c0, T *c1) {
+          T(*SUB)(T a, T b),
+          typename Td,
+          Td(*ADDd)(Td a, Td b),
+          typename C,
+          Td(*LOADC)(const C *cell),
+          T(*GATHER)(const float *table, Td idx)>
+T vectorInformationGain(const EntropyTable &table, int counters, const C *c) {
     T ig = SET(0.0f);
     for (int i = 0; i < counters; i++) {
-        T c = ADD(c0[i], c1[i]);
-        ig = FMA(c0[i], LOG(c0[i]/c), ig);
-        ig = FMA(c1[i], LOG(c1[i]/c), ig);
+        Td n = LOADC(c + i * VL);
+        ig = ADD(ig, GATHER(table.fc[0].data(), n));
+        for (int k = 1; k < table.classes; k++) {
+            Td nk = LOADC(c + (k * counters + i) * VL);
+            ig = ADD(ig, GATHER(table.fc[k].data(), nk));
+            n = ADDd(n, nk);
+        }
+        ig = SUB(ig, GATHER(table.f.data(), n));
     }
     return ig;
 }
 
-template <int VL,
-          typename T>
-T log_scalar(T in) {
-    T out;
-    float *fin = (float*)&in;
-    float *fout = (float*)&out;
-    for (int i = 0; i < VL; ++i) {
-        fout[i] = std::log2(fin[i]);
-    }
-    return out;
 }
 
 #endif /* STATS_VECTOR_H */
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Usage: check_isa_symbols.sh <objects built for AVX/AVX2> -- <all objects>
+#
+# Inline functions and template instantiations are weak symbols, emitted by
+# every object that uses them, and the linker keeps one of the copies. None
+# of them may be a copy with AVX (VEX-encoded) instructions from the vector
+# kernels that the other objects share, or the scalar kernels would run it.
+# Needs GNU nm and objdump (2.32 or newer); the check is skipped without them.
+
+objdump --help 2>/dev/null | grep -q -- '--disassemble=' || exit 0
+nm --version 2>/dev/null | grep -q 'GNU' || exit 0
+
+isa=
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    isa="$isa $1"
+    shift
+done
+shift
+
+tmp=${TMPDIR:-/tmp}/check_isa_symbols.$$
+trap 'rm -f $tmp.*' EXIT
+
+weak() {
+    nm --defined-only "$@" 2>/dev/null | awk '$2 ~ /^[WVu]$/ { print $3 }' | sort -u
+}
+
+status=0
+for o in $isa; do
+    others=
+    for p in "$@"; do
+        [ "$p" = "$o" ] || others="$others $p"
+    done
+    weak $others > $tmp.others
+    for s in $(weak $o | comm -12 - $tmp.others); do
+        if objdump -d --no-show-raw-insn --disassemble="$s" $o | awk -F '\t' 'NF > 1 { print $2 }' | grep -q '^v'; then
+            echo "$o: shared weak symbol $s has AVX instructions" >&2
+            status=1
+        fi
+    done
+done
+exit $status